@@ -0,0 +1,302 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Actuation.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static const char magic[] = "DMFA";
+
+static void write_number(string &out, unsigned value) {
+  while (value >= 0x80) {
+    out.push_back((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+static bool read_number(istream &in, unsigned &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int byte = in.get();
+    if (byte == EOF) {
+      return false;
+    }
+    value |= (unsigned)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Actuation::Actuation() : width(0), height(0), time(0), pins(0) {}
+
+Actuation::Actuation(const Graph &graph, const Schedule &schedule)
+    : width(schedule.width), height(schedule.height), time(schedule.time) {
+  int cells = width * height, ports = 2 * (width + height);
+  state.assign(cells + ports, vector<char>(time + 1, ANY));
+  for (int t = 1; t <= time; t++) {
+    vector<bool> on(cells, false), near(cells, false);
+    auto cover = [&](const Schedule::cell_type &cell) {
+      for (int x = max(0, cell.first - 1);
+           x <= min(height - 1, cell.first + 1); x++) {
+        for (int y = max(0, cell.second - 1);
+             y <= min(width - 1, cell.second + 1); y++) {
+          near[x * width + y] = true;
+        }
+      }
+    };
+    for (int id = 0; id < schedule.num_nodes; id++) {
+      auto &cell = schedule.droplet[t][id];
+      if (cell.first != -1) {
+        on[cell.first * width + cell.second] = true;
+        cover(cell);
+      }
+      for (auto &cell : schedule.operation[t][id]) {
+        on[cell.first * width + cell.second] = true;
+        cover(cell);
+      }
+      // a droplet follows any electrode next to where it was
+      if (schedule.droplet[t - 1][id].first != -1) {
+        cover(schedule.droplet[t - 1][id]);
+      }
+    }
+    for (int e = 0; e < cells; e++) {
+      state[e][t] = on[e] ? ON : near[e] ? OFF : ANY;
+    }
+    for (int p = 0; p < ports; p++) {
+      state[cells + p][t] = OFF;
+    }
+  }
+
+  for (int id = 0; id < schedule.num_nodes; id++) {
+    if (graph.nodes[id].type == DISPENSE && schedule.dispenser[id] != -1) {
+      for (int t = 1; t <= time; t++) {
+        if (schedule.droplet[t][id].first != -1) {
+          state[cells + schedule.dispenser[id]][t] = ON;
+          break;
+        }
+      }
+    }
+  }
+  for (auto &edge : graph.edges) {
+    if (graph.nodes[edge.second].type != OUTPUT) {
+      continue;
+    }
+    for (int t = 2; t <= time; t++) {
+      auto &from = schedule.droplet[t - 1][edge.first];
+      if (from.first == -1 || schedule.droplet[t][edge.first].first != -1) {
+        continue;
+      }
+      for (int p = 0; p < ports; p++) {
+        if (schedule.sink[p] && schedule.port_cell(p) == from) {
+          state[cells + p][t] = ON;
+          break;
+        }
+      }
+    }
+  }
+
+  pin.resize(cells + ports);
+  for (int e = 0; e < pin.size(); e++) {
+    pin[e] = e;
+  }
+  pins = pin.size();
+  build_frames();
+}
+
+// Greedy colouring of the conflict graph, electrodes that matter at the
+// most steps first.
+void Actuation::minimize_pins() {
+  if (state.empty()) {
+    throw logic_error("Pins can only be merged with the schedule at hand");
+  }
+  int cells = width * height;
+  vector<int> cared(cells, 0), order;
+  for (int e = 0; e < cells; e++) {
+    cared[e] = time - count(state[e].begin() + 1, state[e].end(), ANY);
+    order.push_back(e);
+  }
+  stable_sort(order.begin(), order.end(),
+              [&](int a, int b) { return cared[a] > cared[b]; });
+
+  vector<vector<char>> merged;
+  for (int e : order) {
+    int found = -1;
+    for (int k = 0; k < merged.size() && found == -1; k++) {
+      found = k;
+      for (int t = 1; t <= time; t++) {
+        if (state[e][t] != ANY && merged[k][t] != ANY &&
+            state[e][t] != merged[k][t]) {
+          found = -1;
+          break;
+        }
+      }
+    }
+    if (found == -1) {
+      found = merged.size();
+      merged.emplace_back(time + 1, ANY);
+    }
+    for (int t = 1; t <= time; t++) {
+      if (state[e][t] != ANY) {
+        merged[found][t] = state[e][t];
+      }
+    }
+    pin[e] = found;
+  }
+  pins = merged.size();
+  for (int e = cells; e < pin.size(); e++) {
+    pin[e] = pins++;
+  }
+  build_frames();
+}
+
+void Actuation::build_frames() {
+  frame.assign(time + 1, vector<bool>(pins, false));
+  for (int e = 0; e < pin.size(); e++) {
+    for (int t = 1; t <= time; t++) {
+      if (state[e][t] == ON) {
+        frame[t][pin[e]] = true;
+      }
+    }
+  }
+}
+
+bool Actuation::load(const char *file) {
+  ifstream in(file, ios::binary);
+  if (!in) {
+    return false;
+  }
+  return load(in);
+}
+
+bool Actuation::load(istream &in) {
+  char header[4];
+  if (!in.read(header, 4) || !equal(header, header + 4, magic)) {
+    return false;
+  }
+  unsigned w, h, n, p;
+  if (!read_number(in, w) || !read_number(in, h) || !read_number(in, n) ||
+      !read_number(in, p)) {
+    return false;
+  }
+  width = w;
+  height = h;
+  time = n;
+  pins = p;
+  state.clear();
+  pin.assign(width * height + 2 * (width + height), 0);
+  for (auto &value : pin) {
+    unsigned number;
+    if (!read_number(in, number) || number >= pins) {
+      return false;
+    }
+    value = number;
+  }
+  frame.assign(time + 1, vector<bool>(pins, false));
+  for (int t = 1; t <= time; t++) {
+    int kind = in.get();
+    if (kind == 0) {
+      for (int k = 0; k < pins; k += 8) {
+        int byte = in.get();
+        if (byte == EOF) {
+          return false;
+        }
+        for (int b = 0; b < 8 && k + b < pins; b++) {
+          frame[t][k + b] = byte >> b & 1;
+        }
+      }
+    } else if (kind == 1) {
+      frame[t] = frame[t - 1];
+      unsigned runs, length;
+      if (!read_number(in, runs)) {
+        return false;
+      }
+      // alternating runs of kept and flipped pins, kept first
+      int k = 0;
+      for (unsigned r = 0; r < runs; r++) {
+        if (!read_number(in, length) || k + length > pins) {
+          return false;
+        }
+        for (unsigned j = 0; r % 2 == 1 && j < length; j++) {
+          frame[t][k + j] = !frame[t][k + j];
+        }
+        k += length;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Actuation::save(const char *file) const {
+  ofstream out(file, ios::binary);
+  save(out);
+}
+
+void Actuation::save(ostream &out) const {
+  string data(magic, 4);
+  write_number(data, width);
+  write_number(data, height);
+  write_number(data, time);
+  write_number(data, pins);
+  for (int value : pin) {
+    write_number(data, value);
+  }
+  for (int t = 1; t <= time; t++) {
+    string packed(1, 0);
+    for (int k = 0; k < pins; k += 8) {
+      int byte = 0;
+      for (int b = 0; b < 8 && k + b < pins; b++) {
+        byte |= frame[t][k + b] << b;
+      }
+      packed.push_back((char)byte);
+    }
+    vector<unsigned> lengths(1, 0);
+    for (int k = 0; k < pins; k++) {
+      bool flipped = frame[t][k] != frame[t - 1][k];
+      if (flipped != (lengths.size() % 2 == 0)) {
+        lengths.push_back(0);
+      }
+      lengths.back()++;
+    }
+    string delta(1, 1);
+    write_number(delta, lengths.size());
+    for (unsigned length : lengths) {
+      write_number(delta, length);
+    }
+    data += delta.size() < packed.size() ? delta : packed;
+  }
+  out.write(data.data(), data.size());
+}
+
+int Actuation::get_time() const { return time; }
+
+int Actuation::get_electrodes() const { return pin.size(); }
+
+int Actuation::get_pins() const { return pins; }
+
+int Actuation::get_pin(int electrode) const { return pin[electrode]; }
+
+bool Actuation::get(int t, int pin) const { return frame[t][pin]; }
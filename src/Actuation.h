@@ -0,0 +1,72 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ACTUATION_H__
+#define __ACTUATION_H__
+
+#include <iostream>
+#include <vector>
+#include "Graph.h"
+#include "Schedule.h"
+
+// The electrode activations of a schedule, one frame per time step, as
+// sent to the chip controller. Electrodes are the cells row by row, then
+// the ports: a dispenser is on at the step its droplet appears and a sink
+// at the step its droplet leaves. Each electrode is driven by a pin, one of
+// its own unless minimize_pins() merged it with others.
+class Actuation {
+ public:
+  Actuation();
+  Actuation(const Graph &graph, const Schedule &schedule);
+
+  // Shares pins between electrodes whose activations never disagree while
+  // a droplet is close enough to notice. Ports keep pins of their own.
+  void minimize_pins();
+
+  // Binary: a header and the pin of every electrode, then per frame either
+  // the packed bits of the pins or the runs of the bits that changed since
+  // the last frame, whichever is shorter. Numbers are LEB128.
+  bool load(const char *file);
+  bool load(std::istream &in);
+  void save(const char *file) const;
+  void save(std::ostream &out) const;
+
+  int get_time() const;
+  int get_electrodes() const;
+  int get_pins() const;
+  int get_pin(int electrode) const;
+  // whether a pin is on at time step t, numbered from 1
+  bool get(int t, int pin) const;
+
+ private:
+  enum State { OFF, ON, ANY };
+
+  void build_frames();
+
+  int width;
+  int height;
+  int time;
+  int pins;
+  std::vector<int> pin;
+  // state[e][t] of electrode e, empty when loaded
+  std::vector<std::vector<char>> state;
+  // frame[t][pin]
+  std::vector<std::vector<bool>> frame;
+};
+
+#endif
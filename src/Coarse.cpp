@@ -0,0 +1,134 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Coarse.h"
+#include <z3++.h>
+#include <functional>
+#include <stdexcept>
+#include "Solver.h"
+#include "Verifier.h"
+
+using namespace z3;
+using namespace std;
+
+Coarse::Coarse(const Graph &graph, int width, int height, int factor,
+               const Device &device)
+    : graph(graph), width(width), height(height), factor(factor),
+      device(device), timeout(0), macro_steps(0), unrefined(0) {
+  if (factor < 1) {
+    throw logic_error("Macro-steps should be at least one step long");
+  }
+  // the refinement orders the droplets of a macro-step freely
+  this->graph.symmetric.clear();
+}
+
+int Coarse::get_macro_steps() const { return macro_steps; }
+
+int Coarse::get_unrefined() const { return unrefined; }
+
+bool Coarse::run(Schedule &result, int max_steps, unsigned timeout) {
+  this->timeout = timeout;
+  unrefined = 0;
+  for (int steps = 1; steps <= max_steps; steps++) {
+    Schedule coarse;
+    if (!solve(steps, factor, nullptr, coarse)) {
+      continue;
+    }
+    // a coarse schedule with no refinement may still have a longer one
+    // that does
+    if (!solve(steps * factor, 1, &coarse, result)) {
+      unrefined++;
+      continue;
+    }
+    macro_steps = steps;
+    Verifier verifier(graph, device);
+    verifier.trim(result);
+    squeeze(result);
+    return true;
+  }
+  return false;
+}
+
+// Without boundary, a solve with the given stride from scratch. With it,
+// an exact solve with the droplets of every factor-th step fixed to the
+// next step of the boundary schedule.
+bool Coarse::solve(int steps, int stride, const Schedule *boundary,
+                   Schedule &result) {
+  context ctx;
+  check_result answer = unknown;
+  try {
+    Solver solver(ctx, graph, width, height, steps, 0, device, false, false,
+                  stride);
+    z3::solver plain(ctx);
+    plain.add(solver.get_constraints());
+    if (boundary) {
+      Schedule base(width, height, steps, graph.nodes.size());
+      for (int m = 1; m <= boundary->time; m++) {
+        base.droplet[m * factor] = boundary->droplet[m];
+        base.operation[m * factor] = boundary->operation[m];
+      }
+      base.dispenser = boundary->dispenser;
+      base.sink = boundary->sink;
+      base.detector = boundary->detector;
+      // droplets consumed before the next boundary meet their partners at
+      // whatever step the exact durations need
+      std::function<bool(int, int, int, int)> free =
+          [&](int, int, int id, int t) {
+            if (t == 0 || t % factor != 0) {
+              return t != 0;
+            }
+            int m = t / factor;
+            return m < boundary->time &&
+                   boundary->droplet[m][id].first != -1 &&
+                   boundary->droplet[m + 1][id].first == -1;
+          };
+      // the regions of the coarse schedule are padded with spare cells
+      for (auto &literal : solver.fix(base, free, false)) {
+        plain.add(literal);
+      }
+    }
+    if (timeout) {
+      params p(ctx);
+      p.set("timeout", timeout);
+      plain.set(p);
+    }
+    answer = plain.check();
+    if (answer == sat) {
+      result = solver.extract(plain.get_model());
+    }
+  } catch (z3::exception e) {
+    // out of memory
+    answer = unknown;
+  }
+  return answer == sat;
+}
+
+// Drops the steps in which nothing needs to happen, from the last one
+// back, as long as the schedule stays valid.
+void Coarse::squeeze(Schedule &schedule) {
+  Verifier verifier(graph, device);
+  for (int t = schedule.time; t >= 1; t--) {
+    Schedule shorter = schedule;
+    shorter.droplet.erase(shorter.droplet.begin() + t);
+    shorter.operation.erase(shorter.operation.begin() + t);
+    shorter.time--;
+    if (verifier.verify(shorter)) {
+      schedule = shorter;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __COARSE_H__
+#define __COARSE_H__
+
+#include "Device.h"
+#include "Graph.h"
+#include "Schedule.h"
+
+// Synthesis at two resolutions. A coarse solve places the assay on
+// macro-steps of factor time steps each, in which droplets move up to
+// factor cells and operations last their duration rounded up. Its droplets
+// and regions then fix the steps on macro-step boundaries of an exact
+// solve, which only finds the moves in between. Steps the result does not
+// need are squeezed out afterwards.
+class Coarse {
+ public:
+  Coarse(const Graph &graph, int width, int height, int factor,
+         const Device &device = Device());
+  // tries coarse makespans up to max_steps macro-steps, timeout in ms per
+  // solve or 0 for none
+  bool run(Schedule &result, int max_steps, unsigned timeout = 0);
+  // macro-steps of the coarse schedule that was refined
+  int get_macro_steps() const;
+  // coarse schedules found on the way that had no refinement
+  int get_unrefined() const;
+
+ private:
+  bool solve(int steps, int stride, const Schedule *boundary,
+             Schedule &result);
+  void squeeze(Schedule &schedule);
+
+  Graph graph;
+  int width;
+  int height;
+  int factor;
+  Device device;
+  unsigned timeout;
+  int macro_steps;
+  int unrefined;
+};
+
+#endif
@@ -0,0 +1,239 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Coordinator.h"
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <sstream>
+#include <stdexcept>
+
+using namespace z3;
+using namespace std;
+
+Coordinator::Coordinator(Solver &solver, int num_workers, int cubes_per_worker)
+    : solver(solver), groups(solver.decisions()), started(false) {
+  // split on whole groups until there is enough work for everyone, leaving
+  // out cubes that take the same port or cell twice
+  int target = num_workers * cubes_per_worker;
+  cubes.assign(1, vector<int>());
+  for (int g = 0; g < groups.size() && cubes.size() < target; g++) {
+    vector<vector<int>> next;
+    for (auto &cube : cubes) {
+      for (int d = 0; d < groups[g].size(); d++) {
+        bool taken = false;
+        for (int h = 0; h < cube.size(); h++) {
+          taken |= groups[h][cube[h]].key == groups[g][d].key;
+        }
+        if (!taken) {
+          next.push_back(cube);
+          next.back().push_back(d);
+        }
+      }
+    }
+    cubes = next;
+  }
+
+  workers.resize(num_workers, Worker{-1, nullptr, nullptr, -1, deque<int>()});
+  for (int k = 0; k < cubes.size(); k++) {
+    workers[k % num_workers].queue.push_back(k);
+  }
+}
+
+Coordinator::~Coordinator() {
+  for (int i = 0; i < workers.size(); i++) {
+    stop(i);
+  }
+}
+
+int Coordinator::get_num_cubes() { return cubes.size(); }
+
+void Coordinator::start(unsigned memory) {
+  if (started) {
+    return;
+  }
+  started = true;
+  fflush(stdout);
+  for (int i = 0; i < workers.size(); i++) {
+    int command[2], result[2];
+    if (pipe(command) != 0 || pipe(result) != 0) {
+      throw logic_error("Failed to create pipes for workers");
+    }
+    int pid = fork();
+    if (pid == 0) {
+      // only the own pipes stay open, so that every worker sees the end
+      for (int j = 0; j < i; j++) {
+        fclose(workers[j].in);
+        fclose(workers[j].out);
+      }
+      close(command[1]);
+      close(result[0]);
+      work(fdopen(command[0], "r"), fdopen(result[1], "w"), memory);
+      _exit(0);
+    }
+    close(command[0]);
+    close(result[1]);
+    workers[i].pid = pid;
+    workers[i].in = fdopen(command[1], "w");
+    workers[i].out = fdopen(result[0], "r");
+  }
+}
+
+check_result Coordinator::check(Schedule &schedule,
+                                const atomic<bool> *stop) {
+  start();
+  for (int i = 0; i < workers.size(); i++) {
+    assign(i);
+  }
+  check_result answer = unsat;
+  while (true) {
+    vector<pollfd> fds;
+    vector<int> busy;
+    for (int i = 0; i < workers.size(); i++) {
+      if (workers[i].cube != -1) {
+        fds.push_back(pollfd{fileno(workers[i].out), POLLIN, 0});
+        busy.push_back(i);
+      }
+    }
+    if (busy.empty()) {
+      break;
+    }
+    if (stop && *stop) {
+      answer = unknown;
+      break;
+    }
+    if (poll(fds.data(), fds.size(), 10) <= 0) {
+      continue;
+    }
+
+    bool found = false;
+    for (int k = 0; k < busy.size() && !found; k++) {
+      if (fds[k].revents == 0) {
+        continue;
+      }
+      auto &worker = workers[busy[k]];
+      char line[512];
+      int cube = -1;
+      char result[16] = "";
+      if (!fgets(line, sizeof(line), worker.out) ||
+          sscanf(line, "RESULT (%d, %15[a-z])", &cube, result) != 2) {
+        // the worker died, e.g. out of memory, and its queue is stolen
+        answer = unknown;
+        worker.cube = -1;
+        this->stop(busy[k]);
+        continue;
+      }
+      worker.cube = -1;
+      if (strcmp(result, "sat") == 0) {
+        stringstream text;
+        while (fgets(line, sizeof(line), worker.out) &&
+               strcmp(line, "END\n") != 0) {
+          text << line;
+        }
+        found = schedule.load(text);
+      } else if (strcmp(result, "unknown") == 0) {
+        answer = unknown;
+      }
+      if (!found) {
+        assign(busy[k]);
+      }
+    }
+    if (found) {
+      answer = sat;
+      break;
+    }
+  }
+
+  for (int i = 0; i < workers.size(); i++) {
+    this->stop(i);
+  }
+  return answer;
+}
+
+void Coordinator::work(FILE *in, FILE *out, unsigned memory) {
+  if (memory) {
+    // global to z3, but the worker is a process of its own
+    set_param("memory_max_size", (int)memory);
+  }
+  char line[512];
+  int index = 0;
+  while (fgets(line, sizeof(line), in) &&
+         sscanf(line, "CUBE (%d)", &index) == 1) {
+    vector<expr> cube;
+    for (int g = 0; g < cubes[index].size(); g++) {
+      cube.push_back(groups[g][cubes[index][g]].literal);
+    }
+    check_result result = unknown;
+    try {
+      result = solver.check(cube);
+    } catch (z3::exception e) {
+    }
+    fprintf(out, "RESULT (%d, %s)\n", index,
+            result == sat ? "sat" : result == unsat ? "unsat" : "unknown");
+    if (result == sat) {
+      stringstream text;
+      solver.extract(solver.get_solver().get_model()).save(text);
+      fputs(text.str().c_str(), out);
+      fputs("END\n", out);
+    }
+    fflush(out);
+  }
+}
+
+// the next cube from the own queue, or else from the back of the longest
+bool Coordinator::assign(int index) {
+  auto &worker = workers[index];
+  if (worker.pid == -1) {
+    return false;
+  }
+  int victim = index;
+  for (int i = 0; i < workers.size(); i++) {
+    if (worker.queue.empty() &&
+        workers[i].queue.size() > workers[victim].queue.size()) {
+      victim = i;
+    }
+  }
+  if (workers[victim].queue.empty()) {
+    return false;
+  }
+  if (victim == index) {
+    worker.cube = worker.queue.front();
+    worker.queue.pop_front();
+  } else {
+    worker.cube = workers[victim].queue.back();
+    workers[victim].queue.pop_back();
+  }
+  fprintf(worker.in, "CUBE (%d)\n", worker.cube);
+  fflush(worker.in);
+  return true;
+}
+
+void Coordinator::stop(int index) {
+  auto &worker = workers[index];
+  if (worker.pid == -1) {
+    return;
+  }
+  kill(worker.pid, SIGKILL);
+  waitpid(worker.pid, nullptr, 0);
+  fclose(worker.in);
+  fclose(worker.out);
+  worker.pid = -1;
+  worker.cube = -1;
+}
@@ -0,0 +1,71 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __COORDINATOR_H__
+#define __COORDINATOR_H__
+
+#include <z3++.h>
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "Schedule.h"
+#include "Solver.h"
+
+// Cube and conquer over local worker processes. The search is split on the
+// most important decisions of the solver into cubes, which are dealt to
+// workers forked from this process with the encoding already built. Idle
+// workers steal cubes from the busiest one, and the first satisfiable cube
+// stops all of them. Workers talk to the coordinator in text lines over
+// pipes, so they could as well be remote.
+class Coordinator {
+ public:
+  Coordinator(Solver &solver, int workers, int cubes_per_worker = 4);
+  ~Coordinator();
+  // forks the workers, each giving up past memory MB (0 for no limit); a
+  // forked child of a process with other threads may deadlock, so call it
+  // before starting any
+  void start(unsigned memory = 0);
+  // starts the workers unless done yet, gives up with unknown once *stop is
+  // set, and the workers are killed when it returns
+  z3::check_result check(Schedule &schedule,
+                         const std::atomic<bool> *stop = nullptr);
+  int get_num_cubes();
+
+ private:
+  struct Worker {
+    int pid;    // -1 once stopped
+    FILE *in;   // commands to the worker
+    FILE *out;  // results from the worker
+    int cube;   // being solved, or -1 when idle
+    std::deque<int> queue;
+  };
+
+  void work(FILE *in, FILE *out, unsigned memory);
+  bool assign(int index);
+  void stop(int index);
+
+  Solver &solver;
+  std::vector<std::vector<Solver::Decision>> groups;
+  // cubes[k][g]: index of the decision taken in group g
+  std::vector<std::vector<int>> cubes;
+  std::vector<Worker> workers;
+  bool started;
+};
+
+#endif
@@ -0,0 +1,96 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Device.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include "Graph.h"
+
+using namespace std;
+
+int Mixer::duration(int time) const {
+  return max(1, (time * percent + 99) / 100);
+}
+
+vector<Mixer::footprint_type> Mixer::footprints() const {
+  int direction[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+  vector<footprint_type> result;
+  for (int turn = 0; turn < 2; turn++) {
+    int mix_height = turn ? cols : rows;
+    int mix_width = turn ? rows : cols;
+    for (int way = 0; way < 4; way++) {
+      footprint_type footprint;
+      for (int ii = 0; ii < mix_height; ii++) {
+        for (int jj = 0; jj < mix_width; jj++) {
+          footprint.emplace_back(ii * direction[way][0],
+                                 jj * direction[way][1]);
+        }
+      }
+      // a line or a square looks the same in several orientations
+      auto key = footprint;
+      sort(key.begin(), key.end());
+      bool seen = false;
+      for (auto &other : result) {
+        auto other_key = other;
+        sort(other_key.begin(), other_key.end());
+        seen |= other_key == key;
+      }
+      if (!seen) {
+        result.push_back(footprint);
+      }
+    }
+  }
+  return result;
+}
+
+Device::Device() : mixers(1, Mixer{2, 2, 100}) {}
+
+bool Device::load(const char *file) {
+  ifstream in(file);
+  if (!in) {
+    return false;
+  }
+  mixers.clear();
+  while (!in.eof()) {
+    string line;
+    getline(in, line);
+    if (line.find('(') == string::npos)
+      continue;
+
+    string name(line, 0, line.find('('));
+    trim(name);
+
+    auto begin = line.find('(') + 1, next = string::npos;
+    vector<int> params;
+    while ((next = line.find_first_of(",)", begin)) != string::npos) {
+      string param(line, begin, next - begin);
+      trim(param);
+      params.push_back(stoi(param));
+      begin = next + 1;
+    }
+
+    if (name == "MIXER" && params.size() == 3 && params[0] > 0 &&
+        params[1] > 0 && params[0] * params[1] > 1 && params[2] > 0) {
+      mixers.push_back(Mixer{params[0], params[1], params[2]});
+    } else {
+      return false;
+    }
+  }
+  return !mixers.empty();
+}
@@ -0,0 +1,49 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __DEVICE_H__
+#define __DEVICE_H__
+
+#include <utility>
+#include <vector>
+
+// A mixer of rows x cols cells that mixes in percent of the nominal time
+// of a MIX node, e.g. MIXER (2, 3, 60)
+struct Mixer {
+  typedef std::vector<std::pair<int, int>> footprint_type;
+
+  int rows;
+  int cols;
+  int percent;
+
+  int duration(int time) const;
+  // cell offsets from the anchor, one footprint per distinct orientation
+  std::vector<footprint_type> footprints() const;
+};
+
+// Device profile of the chip. Without a profile only the 2x2 mixer is
+// available and MIX nodes take their nominal time.
+class Device {
+ public:
+  Device();
+  bool load(const char *file);
+
+  std::vector<Mixer> mixers;
+};
+
+#endif
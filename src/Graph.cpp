@@ -17,8 +17,10 @@
 // 
 
 #include "Graph.h"
+#include <algorithm>
 #include <fstream>
 #include <exception>
+#include <stdio.h>
 #include <string.h>
 
 using namespace std;
@@ -59,13 +61,14 @@ Graph::Graph(const char *file) {
     } else if (name == "NODE") {
       Node node;
       node.id = stoi(params[0]) - 1;
+      node.release = 0;
+      node.fluid = -1;
       auto type = params[1];
       if (type == "DISPENSE") {
         node.type = DISPENSE;
         node.fluid_name = params[2];
         node.volume = stoi(params[3]);
         node.label = params[4];
-        this->num_dispenser++;
       } else if (type == "MIX") {
         node.type = MIX;
         node.drops = stoi(params[2]);
@@ -87,6 +90,87 @@ Graph::Graph(const char *file) {
       this->nodes.emplace_back(move(node));
     }
   }
+  index_fluids();
+}
+
+Graph::Graph(const vector<Graph> &graphs, int repeat, int interval) {
+  this->num_output = this->num_dispenser = 0;
+  for (int round = 0; round < repeat; round++) {
+    for (auto &graph : graphs) {
+      if (round == 0) {
+        this->name += (this->name.empty() ? "" : " + ") + graph.name;
+      }
+      int offset = this->nodes.size();
+      for (auto node : graph.nodes) {
+        node.id += offset;
+        if (repeat > 1) {
+          char buffer[32];
+          sprintf(buffer, "_r%d", round + 1);
+          node.label += buffer;
+        }
+        if (node.type == DISPENSE && round * interval > 0) {
+          node.release = max(node.release, round * interval + 1);
+        }
+        this->nodes.emplace_back(move(node));
+      }
+      for (auto &edge : graph.edges) {
+        this->edges.emplace_back(edge.first + offset, edge.second + offset);
+      }
+      // sinks are shared, every one takes droplets of any assay
+      this->num_output = max(this->num_output, graph.num_output);
+    }
+  }
+  index_fluids();
+}
+
+Graph::Graph() { this->num_output = this->num_dispenser = 0; }
+
+void Graph::set_name(const string &name) { this->name = name; }
+
+int Graph::add_node(const Node &node) {
+  if (node.type == INVALID) {
+    throw logic_error("Not supported graph node type");
+  }
+  Node copy = node;
+  copy.id = this->nodes.size();
+  this->num_output += copy.type == OUTPUT;
+  this->nodes.emplace_back(move(copy));
+  index_fluids();
+  return this->nodes.back().id;
+}
+
+void Graph::add_edge(int from, int to) {
+  int n = this->nodes.size();
+  if (from < 0 || from >= n || to < 0 || to >= n || from == to) {
+    throw logic_error("Edge between unknown nodes");
+  }
+  this->edges.emplace_back(from, to);
+}
+
+const string &Graph::get_name() const { return name; }
+
+const vector<Node> &Graph::get_nodes() const { return nodes; }
+
+const vector<Graph::edge_type> &Graph::get_edges() const { return edges; }
+
+int Graph::get_num_output() const { return num_output; }
+
+int Graph::get_num_dispenser() const { return num_dispenser; }
+
+void Graph::index_fluids() {
+  vector<string> fluids;
+  for (auto &node : nodes) {
+    if (node.type == DISPENSE) {
+      auto it = find(fluids.begin(), fluids.end(), node.fluid_name);
+      node.fluid = it - fluids.begin();
+      if (it == fluids.end()) {
+        fluids.push_back(node.fluid_name);
+      }
+    } else {
+      node.fluid = -1;
+    }
+  }
+  num_dispenser = fluids.size();
 }
 
 void Graph::print_to_graphviz(const char *file) {
@@ -24,21 +24,54 @@
 #include <vector>
 #include "Node.h"
 
+void trim(std::string &s);
+
 class Graph {
+ public:
   typedef std::pair<int, int> edge_type;
 
- public:
   Graph(const char* file);
+  // an empty assay to build with add_node() and add_edge()
+  Graph();
+  // disjoint union of the assays sharing one chip, repeated in rounds that
+  // start every interval steps
+  Graph(const std::vector<Graph>& graphs, int repeat = 1, int interval = 0);
   void print_to_graphviz(const char* file);
 
+  void set_name(const std::string& name);
+  // appends a copy of node and returns its id, the next index in nodes
+  int add_node(const Node& node);
+  // droplet of node from goes to node to
+  void add_edge(int from, int to);
+
+  const std::string& get_name() const;
+  const std::vector<Node>& get_nodes() const;
+  const std::vector<edge_type>& get_edges() const;
+  int get_num_output() const;
+  int get_num_dispenser() const;
+
  private:
+  // numbers the fluids of the DISPENSE nodes, one dispenser port each
+  void index_fluids();
+
   std::string name;
   std::vector<edge_type> edges;
   std::vector<Node> nodes;
   int num_output;
-  int num_dispenser;
+  int num_dispenser;  // distinct fluids
+  // DISPENSE nodes (a, b) of interchangeable sub-DAGs, a is dispensed first
+  // to break the symmetry
+  std::vector<edge_type> symmetric;
 
   friend class Solver;
+  friend class Actuation;
+  friend class Coarse;
+  friend class Heuristic;
+  friend class Online;
+  friend class LocalSearch;
+  friend class Reduction;
+  friend struct Schedule;
+  friend class Verifier;
 };
 
 #endif
@@ -0,0 +1,874 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Heuristic.h"
+#include <algorithm>
+#include <stdlib.h>
+#include "Verifier.h"
+
+using namespace std;
+
+const int neigh[][2] = {{-1, 0}, {0, -1}, {1, 0}, {0, 1}, {0, 0}};
+
+Heuristic::Heuristic(const Graph &graph, int width, int height,
+                     const Device &device)
+    : graph(graph), width(width), height(height), span(1), horizon(1),
+      first(1), built(false), mixers(device.mixers),
+      layout(width, height, 0, 0), num_sinks(0) {
+  // enough for running every operation and every route one after another
+  for (auto &node : graph.nodes) {
+    if (node.type == MIX) {
+      int slowest = 0;
+      for (auto &mixer : mixers) {
+        slowest = max(slowest, mixer.duration(node.time));
+      }
+      span += slowest + 1;
+    } else if (node.type == DETECT) {
+      span += node.time + 1;
+    }
+  }
+  span += graph.nodes.size() * (width + height);
+  // after waiting for the last round of a pipeline
+  int latest = 0;
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE) {
+      latest = max(latest, node.release);
+    }
+  }
+  span += latest;
+}
+
+bool Heuristic::run(Schedule &schedule) {
+  return run(schedule, Schedule(width, height, 0, graph.nodes.size()), 0);
+}
+
+bool Heuristic::run(Schedule &schedule, const Schedule &prefix,
+                    int executed) {
+  int n = graph.nodes.size();
+  int cells = width * height;
+  // every fluid and every output claims at least a port of its own
+  if (graph.num_dispenser + graph.num_output > 2 * (width + height)) {
+    return false;
+  }
+  horizon = span + prefix.time;
+  first = executed + 1;
+  built = false;
+  tracks.assign(n, Track{0, vector<int>(), false});
+  occupied.assign(horizon + 2, vector<int>(cells, 0));
+  near = occupied;
+  region = occupied;
+  operation.assign(n, vector<pair<int, int>>());
+  port_owner.assign(2 * (width + height), -1);
+  port_users.assign(2 * (width + height), 0);
+  dispenser.assign(n, -1);
+  detector.assign(n, -1);
+  has_detector.assign(cells, false);
+  vanish.assign(n, 0);
+  num_sinks = 0;
+
+  // droplets are never split, so each one feeds at most one operation
+  vector<int> next(n, -1);
+  for (auto &edge : graph.edges) {
+    if (next[edge.first] != -1) {
+      return false;
+    }
+    next[edge.first] = edge.second;
+  }
+
+  // priority is the length of the critical path to the end of the assay
+  vector<int> priority(n, 0);
+  for (int i = 0; i < n; i++) {
+    for (int j = i, steps = 0; j != -1 && steps <= n; j = next[j], steps++) {
+      priority[i] += duration(j) + 1;
+    }
+  }
+
+  // dispensing is planned together with the consuming operation
+  vector<bool> planned(n, false);
+  for (int i = 0; i < n; i++) {
+    planned[i] = graph.nodes[i].type == DISPENSE && next[i] != -1;
+  }
+  if (executed > 0 && !resume(prefix, executed, planned)) {
+    return false;
+  }
+  // a node that does not fit yet waits until another one changed the grid,
+  // which may free the room it needs
+  vector<bool> waiting(n, false);
+  while (true) {
+    int best = -1;
+    bool first_parked = false;
+    for (int i = 0; i < n; i++) {
+      if (planned[i] || waiting[i]) {
+        continue;
+      }
+      bool ready = true, parked = true;
+      for (auto &edge : graph.edges) {
+        if (edge.second == i) {
+          ready = ready && planned[edge.first];
+          parked = parked && tracks[edge.first].start != 0;
+        }
+      }
+      // consuming droplets parked on the grid frees the cells they hold,
+      // so such nodes go first
+      if (ready && (best == -1 || (parked && !first_parked) ||
+                    (parked == first_parked && priority[i] > priority[best]))) {
+        best = i;
+        first_parked = parked;
+      }
+    }
+    if (best == -1) {
+      break;
+    }
+
+    bool ok = false;
+    switch (graph.nodes[best].type) {
+      case MIX:
+        ok = plan_mix(best);
+        break;
+      case DETECT:
+        ok = plan_detect(best);
+        break;
+      case OUTPUT:
+        ok = plan_output(best);
+        break;
+      case DISPENSE:
+        ok = plan_dispense(best);
+        break;
+      default:
+        break;
+    }
+    if (!ok) {
+      waiting[best] = true;
+      continue;
+    }
+    planned[best] = true;
+    waiting.assign(n, false);
+  }
+  if (find(planned.begin(), planned.end(), false) != planned.end()) {
+    return false;
+  }
+  // the encoding has a sink per OUTPUT node, shared ones leave some unused
+  for (int p = 0; p < port_owner.size() && num_sinks < graph.num_output;
+       p++) {
+    if (port_owner[p] == -1) {
+      port_owner[p] = -2;
+      num_sinks++;
+    }
+  }
+
+  int time = max(1, executed);
+  for (int i = 0; i < n; i++) {
+    if (tracks[i].start != 0) {
+      time = max(time, tracks[i].start + (int)tracks[i].cells.size() - 1);
+    }
+    time = max(time, vanish[i]);
+  }
+
+  schedule = Schedule(width, height, time, n);
+  auto to_cell = [&](int cell) {
+    return Schedule::cell_type(cell / width, cell % width);
+  };
+  for (int i = 0; i < n; i++) {
+    auto &track = tracks[i];
+    if (track.start != 0) {
+      int t = track.start;
+      for (int cell : track.cells) {
+        schedule.droplet[t++][i] = to_cell(cell);
+      }
+      for (; track.parked && t <= time; t++) {
+        schedule.droplet[t][i] = to_cell(track.cells.back());
+      }
+    }
+    for (auto &slot : operation[i]) {
+      schedule.operation[slot.second][i].push_back(to_cell(slot.first));
+    }
+    if (detector[i] != -1) {
+      schedule.detector[i] = to_cell(detector[i]);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    schedule.dispenser[i] = dispenser[i];
+  }
+  for (int p = 0; p < port_owner.size(); p++) {
+    schedule.sink[p] = port_owner[p] == -2;
+  }
+  for (int t = 1; t <= executed; t++) {
+    schedule.droplet[t] = prefix.droplet[t];
+    schedule.operation[t] = prefix.operation[t];
+  }
+  // reject what the planner got wrong rather than hand it to the solver
+  Device device;
+  device.mixers = mixers;
+  return Verifier(graph, device).verify(schedule);
+}
+
+// Takes over what the chip has: the ports and detectors of prefix, the
+// droplets on the grid after its executed steps, parked where they are,
+// and the operations under way, which keep their place until their output
+// appears.
+bool Heuristic::resume(const Schedule &prefix, int executed,
+                       vector<bool> &planned) {
+  int n = graph.nodes.size();
+  if (prefix.width != width || prefix.height != height ||
+      prefix.num_nodes != n || executed > prefix.time) {
+    return false;
+  }
+  auto index = [&](const Schedule::cell_type &cell) {
+    return cell.first * width + cell.second;
+  };
+  built = true;
+  for (int p = 0; p < port_owner.size(); p++) {
+    if (prefix.sink[p]) {
+      port_owner[p] = -2;
+      num_sinks++;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (graph.nodes[i].type == DISPENSE && prefix.dispenser[i] != -1) {
+      port_owner[prefix.dispenser[i]] = graph.nodes[i].fluid;
+    }
+    if (prefix.detector[i].first != -1) {
+      detector[i] = index(prefix.detector[i]);
+      has_detector[detector[i]] = true;
+    }
+  }
+
+  vector<bool> seen(n, false), present(n, false);
+  for (int i = 0; i < n; i++) {
+    for (int t = 1; t <= executed; t++) {
+      seen[i] = seen[i] || prefix.droplet[t][i].first != -1;
+    }
+    present[i] = prefix.droplet[executed][i].first != -1;
+    if (seen[i]) {
+      planned[i] = true;
+      if (graph.nodes[i].type == DISPENSE) {
+        if (prefix.dispenser[i] == -1) {
+          return false;
+        }
+        claim(i, prefix.dispenser[i]);
+      }
+    }
+    if (present[i]) {
+      int t = executed;
+      while (t > 1 && prefix.droplet[t - 1][i].first != -1) {
+        t--;
+      }
+      tracks[i] = Track{t, vector<int>(), true};
+      for (; t <= executed; t++) {
+        tracks[i].cells.push_back(index(prefix.droplet[t][i]));
+      }
+      reserve(i, 1);
+    }
+  }
+
+  // a node whose inputs left the grid has started
+  for (int i = 0; i < n; i++) {
+    int inputs = 0, gone = 0;
+    for (auto &edge : graph.edges) {
+      if (edge.second == i) {
+        inputs++;
+        gone += seen[edge.first] && !present[edge.first];
+      }
+    }
+    if (seen[i] || gone == 0) {
+      continue;
+    } else if (gone < inputs) {
+      return false;
+    }
+    planned[i] = true;
+    if (graph.nodes[i].type == OUTPUT) {
+      continue;
+    }
+    int t = executed + 1;
+    for (; t <= prefix.time && prefix.droplet[t][i].first == -1; t++) {
+      for (auto &cell : prefix.operation[t][i]) {
+        mark_region(vector<int>(1, index(cell)), t, t);
+        operation[i].emplace_back(index(cell), t);
+      }
+    }
+    if (t > prefix.time) {
+      return false;
+    }
+    tracks[i] = Track{t, vector<int>(1, index(prefix.droplet[t][i])), true};
+    reserve(i, 1);
+  }
+  return true;
+}
+
+bool Heuristic::plan_mix(int id) {
+  auto &node = graph.nodes[id];
+  vector<int> inputs;
+  for (auto &edge : graph.edges) {
+    if (edge.second == id) {
+      inputs.push_back(edge.first);
+    }
+  }
+  if (inputs.empty()) {
+    return false;
+  }
+  // droplets already on the grid are routed before fresh ones
+  stable_sort(inputs.begin(), inputs.end(), [&](int a, int b) {
+    return tracks[a].start != 0 && tracks[b].start == 0;
+  });
+
+  struct Candidate {
+    int bound;
+    int anchor;
+    int time;
+    vector<int> footprint;
+  };
+  vector<Candidate> candidates;
+  for (int x = 0; x < height; x++) {
+    for (int y = 0; y < width; y++) {
+      for (auto &mixer : mixers) {
+        for (auto &offsets : mixer.footprints()) {
+          Candidate candidate;
+          candidate.anchor = x * width + y;
+          candidate.time = mixer.duration(node.time);
+          candidate.bound = 1;
+          for (int in : inputs) {
+            candidate.bound = max(candidate.bound,
+                                  lower_bound(in, candidate.anchor) - 1);
+          }
+          for (auto &offset : offsets) {
+            int xx = x + offset.first, yy = y + offset.second;
+            if (0 <= xx && xx < height && 0 <= yy && yy < width) {
+              candidate.footprint.push_back(xx * width + yy);
+            }
+          }
+          if (candidate.footprint.size() == offsets.size()) {
+            candidates.push_back(candidate);
+          }
+        }
+      }
+    }
+  }
+  // by the earliest step the output could appear
+  stable_sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+                return a.bound + a.time < b.bound + b.time;
+              });
+  if (candidates.empty()) {
+    return false;
+  }
+
+  int first = candidates[0].bound + candidates[0].time + 1;
+  for (int t_out = first; t_out <= settled(id); t_out++) {
+    for (auto &candidate : candidates) {
+      if (candidate.bound + candidate.time + 1 > t_out) {
+        break;
+      }
+      int t0 = t_out - candidate.time - 1;
+      if (!window_free(candidate.footprint, t0 + 1, t_out - 1, inputs)) {
+        continue;
+      }
+
+      // every input has to reach the neighbourhood of the anchor at t0
+      vector<Track> old;
+      vector<int> partners;
+      for (int in : inputs) {
+        int x = candidate.anchor / width, y = candidate.anchor % width;
+        vector<int> targets;
+        for (int d = 0; d < 5; d++) {
+          int xx = x + neigh[d][0];
+          int yy = y + neigh[d][1];
+          int target = xx * width + yy;
+          if (0 <= xx && xx < height && 0 <= yy && yy < width &&
+              find(partners.begin(), partners.end(), target) ==
+                  partners.end()) {
+            targets.push_back(target);
+          }
+        }
+        stable_sort(targets.begin(), targets.end(), [&](int a, int b) {
+          return lower_bound(in, a) < lower_bound(in, b);
+        });
+        old.push_back(tracks[in]);
+        for (int target : targets) {
+          if (route(in, target, t0, partners)) {
+            partners.push_back(target);
+            break;
+          }
+        }
+        if (partners.size() != old.size()) {
+          break;
+        }
+      }
+
+      if (partners.size() == inputs.size() &&
+          window_free(candidate.footprint, t0 + 1, t_out - 1, vector<int>()) &&
+          can_park(candidate.anchor, t_out)) {
+        mark_region(candidate.footprint, t0 + 1, t_out - 1);
+        for (int cell : candidate.footprint) {
+          for (int t = t0 + 1; t < t_out; t++) {
+            operation[id].emplace_back(cell, t);
+          }
+        }
+        tracks[id] = Track{t_out, vector<int>(1, candidate.anchor), true};
+        reserve(id, 1);
+        return true;
+      }
+      for (int k = partners.size() - 1; k >= 0; k--) {
+        unroute(inputs[k], old[k]);
+      }
+    }
+  }
+  return false;
+}
+
+bool Heuristic::plan_detect(int id) {
+  auto &node = graph.nodes[id];
+  int input = -1;
+  for (auto &edge : graph.edges) {
+    if (edge.second == id) {
+      if (input != -1) {
+        return false;
+      }
+      input = edge.first;
+    }
+  }
+  if (input == -1) {
+    return false;
+  }
+
+  // a detector of this fluid may already be placed by an earlier DETECT
+  vector<pair<int, int>> candidates;
+  for (int cell = 0; cell < width * height; cell++) {
+    if (detector[input] == -1 ? !has_detector[cell]
+                              : detector[input] == cell) {
+      candidates.emplace_back(max(1, lower_bound(input, cell)), cell);
+    }
+  }
+  sort(candidates.begin(), candidates.end());
+  if (candidates.empty()) {
+    return false;
+  }
+
+  vector<int> inputs(1, input);
+  for (int t0 = candidates[0].first; t0 + node.time + 1 <= settled(id);
+       t0++) {
+    int t_out = t0 + node.time + 1;
+    for (auto &candidate : candidates) {
+      if (candidate.first > t0) {
+        break;
+      }
+      vector<int> footprint(1, candidate.second);
+      if (!window_free(footprint, t0 + 1, t_out - 1, inputs)) {
+        continue;
+      }
+      Track old = tracks[input];
+      if (!route(input, candidate.second, t0, vector<int>())) {
+        continue;
+      }
+      if (window_free(footprint, t0 + 1, t_out - 1, vector<int>()) &&
+          can_park(candidate.second, t_out)) {
+        detector[input] = candidate.second;
+        has_detector[candidate.second] = true;
+        mark_region(footprint, t0 + 1, t_out - 1);
+        for (int t = t0 + 1; t < t_out; t++) {
+          operation[id].emplace_back(candidate.second, t);
+        }
+        tracks[id] = Track{t_out, footprint, true};
+        reserve(id, 1);
+        return true;
+      }
+      unroute(input, old);
+    }
+  }
+  return false;
+}
+
+bool Heuristic::plan_output(int id) {
+  int input = -1;
+  for (auto &edge : graph.edges) {
+    if (edge.second == id) {
+      input = edge.first;
+      break;
+    }
+  }
+  if (input == -1) {
+    return true;
+  }
+
+  // sinks are shared, new ones are opened while there are fewer than
+  // the number of OUTPUT nodes
+  vector<pair<int, int>> candidates;
+  for (int p = 0; p < port_owner.size(); p++) {
+    if (port_owner[p] == -2 ||
+        (port_owner[p] == -1 && num_sinks < graph.num_output)) {
+      auto cell = layout.port_cell(p);
+      candidates.emplace_back(
+          max(1, lower_bound(input, cell.first * width + cell.second)), p);
+    }
+  }
+  sort(candidates.begin(), candidates.end());
+  if (candidates.empty()) {
+    return false;
+  }
+
+  for (int t = candidates[0].first; t < settled(id); t++) {
+    for (auto &candidate : candidates) {
+      if (candidate.first > t) {
+        break;
+      }
+      int p = candidate.second;
+      bool opened = port_owner[p] == -1;
+      if (opened) {
+        port_owner[p] = -2;
+        num_sinks++;
+      }
+      auto cell = layout.port_cell(p);
+      if (route(input, cell.first * width + cell.second, t, vector<int>())) {
+        vanish[input] = t + 1;
+        return true;
+      }
+      if (opened) {
+        port_owner[p] = -1;
+        num_sinks--;
+      }
+    }
+  }
+  return false;
+}
+
+bool Heuristic::plan_dispense(int id) {
+  for (int t = max(first, graph.nodes[id].release); t <= settled(id); t++) {
+    for (int cell = 0; cell < width * height; cell++) {
+      int p = free_port(cell, false, graph.nodes[id].fluid);
+      if (p != -1 && valid(cell, t, vector<int>(), -1)) {
+        claim(id, p);
+        tracks[id] = Track{t, vector<int>(1, cell), false};
+        reserve(id, 1);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Routes droplet id to target at exactly t_target by a backward
+// breadth-first search over (cell, time). A droplet on the grid waits on
+// its cell as long as possible; a fresh one is dispensed as late as possible
+// from a free port, which it may pass again later on.
+bool Heuristic::route(int id, int target, int t_target,
+                      const vector<int> &partners) {
+  Track old = tracks[id];
+  auto &track = tracks[id];
+  bool dispensed = track.start == 0;
+  int source = -1, ready = 1, fluid = graph.nodes[id].fluid;
+  if (dispensed && graph.nodes[id].type == DISPENSE) {
+    ready = max(first, graph.nodes[id].release);
+    if (ready > t_target) {
+      return false;
+    }
+  }
+  if (!dispensed) {
+    ready = track.start + track.cells.size() - 1;
+    source = track.cells.back();
+    if (ready > t_target) {
+      return false;
+    }
+    // everything planned since the droplet was parked keeps clear of its
+    // cell, so the wait there needs no further checks
+    reserve(id, -1);
+    track.cells.pop_back();
+    track.parked = false;
+  }
+
+  // next[t][cell]: the cell at t + 1 on the way to the target
+  vector<vector<int>> next(t_target + 1, vector<int>(width * height, -2));
+  int found_cell = -1, found_t = -1, port = -1;
+  if (!dispensed && target == source) {
+    found_cell = target;
+    found_t = t_target;
+    next[t_target][target] = -1;
+  } else if (valid(target, t_target, partners, t_target)) {
+    next[t_target][target] = -1;
+    if (dispensed && (port = free_port(target, false, fluid)) != -1) {
+      found_cell = target;
+      found_t = t_target;
+    }
+  }
+
+  vector<int> frontier;
+  if (next[t_target][target] == -1 && found_cell == -1) {
+    frontier.push_back(target);
+  }
+  for (int t = t_target; t > ready && found_cell == -1 && !frontier.empty();
+       t--) {
+    vector<int> previous;
+    for (int cell : frontier) {
+      int x = cell / width, y = cell % width;
+      for (int d = 0; d < 5 && found_cell == -1; d++) {
+        int xx = x + neigh[d][0];
+        int yy = y + neigh[d][1];
+        int from = xx * width + yy;
+        if (xx < 0 || xx >= height || yy < 0 || yy >= width ||
+            next[t - 1][from] != -2) {
+          continue;
+        }
+        if (!dispensed && from == source) {
+          next[t - 1][from] = cell;
+          found_cell = from;
+          found_t = t - 1;
+          break;
+        }
+        if (!valid(from, t - 1, partners, t_target)) {
+          continue;
+        }
+        next[t - 1][from] = cell;
+        if (dispensed && (port = free_port(from, false, fluid)) != -1) {
+          found_cell = from;
+          found_t = t - 1;
+          break;
+        }
+        previous.push_back(from);
+      }
+    }
+    frontier.swap(previous);
+  }
+
+  if (found_cell == -1) {
+    if (!dispensed) {
+      track = old;
+      reserve(id, 1);
+    }
+    return false;
+  }
+
+  if (dispensed) {
+    claim(id, port);
+    track.start = found_t;
+    track.cells.clear();
+  } else {
+    for (int t = ready; t < found_t; t++) {
+      track.cells.push_back(source);
+    }
+  }
+  for (int c = found_cell, t = found_t; c != -1; c = next[t++][c]) {
+    track.cells.push_back(c);
+  }
+  track.parked = false;
+  reserve(id, 1);
+  return true;
+}
+
+void Heuristic::unroute(int id, const Track &old) {
+  reserve(id, -1);
+  if (old.start == 0) {
+    release(id);
+  }
+  tracks[id] = old;
+  reserve(id, 1);
+}
+
+// No other droplet may be within one cell at t, nor at t - 1 and t + 1
+// (static and dynamic fluidic constraints), except the partners which
+// merge with this droplet at t_partners.
+bool Heuristic::valid(int cell, int t, const vector<int> &partners,
+                      int t_partners) const {
+  if (t < first || t > horizon || region[t][cell] || near[t - 1][cell] ||
+      near[t + 1][cell]) {
+    return false;
+  }
+  int count = near[t][cell];
+  if (t == t_partners) {
+    for (int partner : partners) {
+      if (adjacent(partner, cell)) {
+        count--;
+      }
+    }
+  }
+  return count == 0;
+}
+
+bool Heuristic::can_park(int cell, int from) const {
+  for (int t = from; t <= horizon; t++) {
+    if (!valid(cell, t, vector<int>(), -1)) {
+      return false;
+    }
+  }
+  return from <= horizon;
+}
+
+// whether cells are free of droplets and operations from `from` to `to`,
+// ignoring the parked inputs which leave before the operation starts
+bool Heuristic::window_free(const vector<int> &cells, int from, int to,
+                            const vector<int> &inputs) const {
+  for (int t = from; t <= to; t++) {
+    for (int cell : cells) {
+      int count = occupied[t][cell];
+      for (int in : inputs) {
+        auto &track = tracks[in];
+        if (track.start != 0 && track.parked && track.cells.back() == cell &&
+            t >= track.start + (int)track.cells.size() - 1) {
+          count--;
+        }
+      }
+      if (count || region[t][cell]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Heuristic::reserve(int id, int delta) {
+  auto &track = tracks[id];
+  if (track.start == 0) {
+    return;
+  }
+  int t = track.start;
+  for (int cell : track.cells) {
+    mark(cell, t++, delta);
+  }
+  for (; track.parked && t <= horizon + 1; t++) {
+    mark(track.cells.back(), t, delta);
+  }
+}
+
+void Heuristic::mark(int cell, int t, int delta) {
+  occupied[t][cell] += delta;
+  int x = cell / width, y = cell % width;
+  for (int dx = -1; dx <= 1; dx++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      int xx = x + dx, yy = y + dy;
+      if (0 <= xx && xx < height && 0 <= yy && yy < width) {
+        near[t][xx * width + yy] += delta;
+      }
+    }
+  }
+}
+
+void Heuristic::mark_region(const vector<int> &cells, int from, int to) {
+  for (int t = from; t <= to; t++) {
+    for (int cell : cells) {
+      region[t][cell]++;
+    }
+  }
+}
+
+// a free port next to cell, keeping enough ports for the sinks and the
+// other fluids, or one that already dispenses the same fluid
+int Heuristic::free_port(int cell, bool for_sink, int fluid) const {
+  for (int p = 0; p < port_owner.size(); p++) {
+    auto port = layout.port_cell(p);
+    if (fluid != -1 && port_owner[p] == fluid &&
+        port.first * width + port.second == cell) {
+      return p;
+    }
+  }
+  // and one for every other fluid that has none yet
+  vector<bool> served(graph.num_dispenser, false);
+  for (int owner : port_owner) {
+    if (owner >= 0) {
+      served[owner] = true;
+    }
+  }
+  int unserved = 0;
+  for (int f = 0; f < graph.num_dispenser; f++) {
+    unserved += !served[f] && f != fluid;
+  }
+  int num_free = count(port_owner.begin(), port_owner.end(), -1);
+  if (built ||
+      (!for_sink && num_free <= graph.num_output - num_sinks + unserved)) {
+    return -1;
+  }
+  for (int p = 0; p < port_owner.size(); p++) {
+    auto port = layout.port_cell(p);
+    if (port_owner[p] == -1 && port.first * width + port.second == cell) {
+      return p;
+    }
+  }
+  return -1;
+}
+
+void Heuristic::claim(int id, int port) {
+  port_owner[port] = graph.nodes[id].fluid;
+  port_users[port]++;
+  dispenser[id] = port;
+}
+
+void Heuristic::release(int id) {
+  int port = dispenser[id];
+  if (port != -1 && --port_users[port] == 0 && !built) {
+    port_owner[port] = -1;
+  }
+  dispenser[id] = -1;
+}
+
+// earliest time droplet id could be on cell
+int Heuristic::lower_bound(int id, int cell) const {
+  auto &track = tracks[id];
+  if (track.start != 0) {
+    return track.start + track.cells.size() - 1 +
+           distance(track.cells.back(), cell);
+  }
+  int x = cell / width, y = cell % width;
+  return max(first, graph.nodes[id].release) +
+         min(min(x, height - 1 - x), min(y, width - 1 - y));
+}
+
+// The last step worth trying for node id to finish: after it nothing
+// planned so far moves, so a later step that fits would also have fitted
+// earlier.
+int Heuristic::settled(int id) const {
+  int last = 1;
+  for (int i = 0; i < tracks.size(); i++) {
+    if (tracks[i].start != 0) {
+      last = max(last, tracks[i].start + (int)tracks[i].cells.size() - 1);
+    }
+    last = max(last, vanish[i]);
+    for (auto &slot : operation[i]) {
+      last = max(last, slot.second);
+    }
+    if (graph.nodes[i].type == DISPENSE) {
+      last = max(last, graph.nodes[i].release);
+    }
+  }
+  int slowest = duration(id);
+  for (auto &mixer : mixers) {
+    if (graph.nodes[id].type == MIX) {
+      slowest = max(slowest, mixer.duration(graph.nodes[id].time));
+    }
+  }
+  // enough to route every input around the droplets parked by then
+  return min(horizon, last + slowest + width * height + 2);
+}
+
+// fastest possible run of an operation, 0 for instantaneous ones
+int Heuristic::duration(int id) const {
+  auto &node = graph.nodes[id];
+  if (node.type == DETECT) {
+    return node.time;
+  } else if (node.type != MIX) {
+    return 0;
+  }
+  int fastest = mixers[0].duration(node.time);
+  for (auto &mixer : mixers) {
+    fastest = min(fastest, mixer.duration(node.time));
+  }
+  return fastest;
+}
+
+int Heuristic::distance(int a, int b) const {
+  return abs(a / width - b / width) + abs(a % width - b % width);
+}
+
+bool Heuristic::adjacent(int a, int b) const {
+  return abs(a / width - b / width) <= 1 && abs(a % width - b % width) <= 1;
+}
@@ -0,0 +1,100 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __HEURISTIC_H__
+#define __HEURISTIC_H__
+
+#include <vector>
+#include "Device.h"
+#include "Graph.h"
+#include "Schedule.h"
+
+// Polynomial-time list scheduler and router. Operations are placed one by
+// one, those consuming droplets already on the grid first and otherwise in
+// order of their critical path, each at the earliest time its inputs can be
+// routed to it, so the result is a valid but not optimal schedule. An
+// operation that does not fit waits until another one has been placed.
+class Heuristic {
+ public:
+  Heuristic(const Graph &graph, int width, int height,
+            const Device &device = Device());
+  // returns false when some operation cannot be placed on the grid
+  bool run(Schedule &schedule);
+  // the same after the first executed steps of prefix, which stay as the
+  // chip ran them, with its ports and detectors
+  bool run(Schedule &schedule, const Schedule &prefix, int executed);
+
+ private:
+  struct Track {
+    int start;               // time of cells[0], 0 if not placed yet
+    std::vector<int> cells;  // one cell per time step from start on
+    bool parked;             // stays on the last cell until consumed
+  };
+
+  bool resume(const Schedule &prefix, int executed,
+              std::vector<bool> &planned);
+  bool plan_mix(int id);
+  bool plan_detect(int id);
+  bool plan_output(int id);
+  bool plan_dispense(int id);
+  bool route(int id, int target, int t_target,
+             const std::vector<int> &partners);
+  void unroute(int id, const Track &old);
+  bool valid(int cell, int t, const std::vector<int> &partners,
+             int t_partners) const;
+  bool can_park(int cell, int from) const;
+  bool window_free(const std::vector<int> &cells, int from, int to,
+                   const std::vector<int> &inputs) const;
+  void reserve(int id, int delta);
+  void mark(int cell, int t, int delta);
+  void mark_region(const std::vector<int> &cells, int from, int to);
+  // fluid is that of the droplet to dispense, -1 for a sink
+  int free_port(int cell, bool for_sink, int fluid = -1) const;
+  void claim(int id, int port);
+  void release(int id);
+  int lower_bound(int id, int cell) const;
+  int settled(int id) const;
+  int duration(int id) const;
+  int distance(int a, int b) const;
+  bool adjacent(int a, int b) const;
+
+  const Graph &graph;
+  int width;
+  int height;
+  int span;    // steps enough to plan the whole assay
+  int horizon;
+  int first;   // earliest step still to plan
+  bool built;  // the ports are on the chip already
+  std::vector<Mixer> mixers;
+  Schedule layout;
+  std::vector<Track> tracks;
+  // indexed by time, then by cell x * width + y
+  std::vector<std::vector<int>> occupied;
+  std::vector<std::vector<int>> near;
+  std::vector<std::vector<int>> region;
+  std::vector<std::vector<std::pair<int, int>>> operation;  // cells, time
+  std::vector<int> port_owner;  // -1 free, -2 sink, otherwise the fluid
+  std::vector<int> port_users;  // dispense nodes routed from each port
+  std::vector<int> dispenser;   // port per dispense node, or -1
+  std::vector<int> detector;    // cell per fluid, or -1
+  std::vector<bool> has_detector;
+  std::vector<int> vanish;      // time an output droplet leaves the grid
+  int num_sinks;
+};
+
+#endif
@@ -0,0 +1,191 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "LocalSearch.h"
+#include <z3++.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "Solver.h"
+#include "Verifier.h"
+
+using namespace z3;
+using namespace std;
+using namespace std::chrono;
+
+LocalSearch::LocalSearch(const Graph &graph, const Device &device,
+                         bool compact)
+    : graph(graph), device(device), compact(compact), rounds(0),
+      improvements(0) {
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
+      droplets.push_back(node.id);
+    }
+  }
+}
+
+bool LocalSearch::Neighbourhood::free(int x, int y, int id, int t) const {
+  if (kind == 2) {
+    return id != -1 && nodes[id];
+  } else if (t == 0) {
+    return false;
+  } else if (kind == 0) {
+    return from <= t && t <= to;
+  }
+  return top <= x && x <= bottom && left <= y && y <= right;
+}
+
+// a third of the steps, a quarter of the grid or a third of the droplets
+LocalSearch::Neighbourhood LocalSearch::pick(mt19937 &rng,
+                                             const Schedule &schedule) const {
+  Neighbourhood result;
+  result.kind = rng() % 3;
+  int length = min(schedule.time, max(3, schedule.time / 3));
+  result.from = 1 + rng() % (schedule.time - length + 1);
+  result.to = result.from + length - 1;
+  int rows = (schedule.height + 1) / 2, cols = (schedule.width + 1) / 2;
+  result.top = rng() % (schedule.height - rows + 1);
+  result.bottom = result.top + rows - 1;
+  result.left = rng() % (schedule.width - cols + 1);
+  result.right = result.left + cols - 1;
+  result.nodes.assign(graph.nodes.size(), false);
+  int count = max(2, (int)droplets.size() / 3);
+  for (int k = 0; k < count && !droplets.empty(); k++) {
+    result.nodes[droplets[rng() % droplets.size()]] = true;
+  }
+  return result;
+}
+
+void LocalSearch::run(Schedule &schedule, unsigned limit, int threads,
+                      unsigned seed, const atomic<bool> *stop) {
+  mutex lock;
+  vector<context *> running(threads, nullptr);
+  int finished = 0;
+  Schedule best = schedule;
+  Verifier verifier(graph, device);
+  verifier.trim(best);
+  int best_points = best.num_points();
+  auto deadline = steady_clock::now() + milliseconds(limit);
+  // no single neighbourhood gets the whole budget
+  long long round_limit = max(1000u, limit / 8);
+
+  auto search = [&](int index) {
+    mt19937 rng(seed + index);
+    context ctx;
+    {
+      lock_guard<mutex> guard(lock);
+      running[index] = &ctx;
+    }
+    try {
+      Solver solver(ctx, graph, schedule.width, schedule.height,
+                    schedule.time, 0, device, compact);
+      expr_vector constraints = solver.get_constraints();
+      while (true) {
+        long long left =
+            duration_cast<milliseconds>(deadline - steady_clock::now())
+                .count();
+        if (left <= 0 || (stop && *stop)) {
+          break;
+        }
+        Schedule base;
+        int bound;
+        {
+          lock_guard<mutex> guard(lock);
+          base = best;
+          bound = best_points;
+        }
+        auto neighbourhood = pick(rng, base);
+        auto free = [&](int x, int y, int id, int t) {
+          return neighbourhood.free(x, y, id, t);
+        };
+        // asking for any better schedule is much cheaper than proving the
+        // optimum of the neighbourhood, and fixed variables as facts rather
+        // than assumptions let z3 simplify most of the encoding away
+        z3::solver plain(ctx);
+        plain.add(constraints);
+        for (auto &literal : solver.fix(base, free)) {
+          plain.add(literal);
+        }
+        // descend within the neighbourhood while z3 keeps finding better
+        auto until = steady_clock::now() + milliseconds(min(left, round_limit));
+        Schedule found;
+        bool improved = false;
+        while (true) {
+          long long remaining =
+              duration_cast<milliseconds>(until - steady_clock::now()).count();
+          if (remaining <= 0) {
+            break;
+          }
+          plain.add(solver.get_objective() < bound);
+          params p(ctx);
+          p.set("timeout", (unsigned)remaining);
+          plain.set(p);
+          if (plain.check() != sat) {
+            break;
+          }
+          found = solver.extract(plain.get_model());
+          bound = found.num_points();
+          improved = true;
+        }
+
+        // every model is a whole schedule, so it stays valid even when
+        // another thread improved the base meanwhile
+        lock_guard<mutex> guard(lock);
+        rounds++;
+        if (improved && found.num_points() < best_points &&
+            verifier.verify(found)) {
+          best = found;
+          best_points = found.num_points();
+          improvements++;
+        }
+      }
+    } catch (z3::exception e) {
+      // out of memory or interrupted, the best schedule so far stands
+    }
+    lock_guard<mutex> guard(lock);
+    running[index] = nullptr;
+    finished++;
+  };
+
+  vector<thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(search, i);
+  }
+  // an interrupt only stops a running check, as in Portfolio
+  while (stop) {
+    this_thread::sleep_for(milliseconds(10));
+    lock_guard<mutex> guard(lock);
+    if (finished == threads) {
+      break;
+    }
+    for (int i = 0; *stop && i < threads; i++) {
+      if (running[i]) {
+        running[i]->interrupt();
+      }
+    }
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  schedule = best;
+}
+
+int LocalSearch::get_rounds() { return rounds; }
+
+int LocalSearch::get_improvements() { return improvements; }
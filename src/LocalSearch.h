@@ -0,0 +1,64 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __LOCAL_SEARCH_H__
+#define __LOCAL_SEARCH_H__
+
+#include <atomic>
+#include <random>
+#include <vector>
+#include "Device.h"
+#include "Graph.h"
+#include "Schedule.h"
+
+// Large neighbourhood search on the number of points of a valid schedule.
+// Every round frees a time window, a region of the grid or a few droplets,
+// fixes everything else to the best schedule so far and minimizes num_points
+// over the free part with the encoding of Solver. Threads work on their own
+// neighbourhoods and share the best schedule.
+class LocalSearch {
+ public:
+  LocalSearch(const Graph &graph, const Device &device = Device(),
+              bool compact = false);
+  // improves schedule in place for limit milliseconds, or until *stop is set
+  void run(Schedule &schedule, unsigned limit, int threads = 1,
+           unsigned seed = 0, const std::atomic<bool> *stop = nullptr);
+  int get_rounds();
+  int get_improvements();
+
+ private:
+  struct Neighbourhood {
+    int kind;  // 0 for a time window, 1 for a region, 2 for droplets
+    int from, to;
+    int top, left, bottom, right;
+    std::vector<bool> nodes;
+
+    bool free(int x, int y, int id, int t) const;
+  };
+
+  Neighbourhood pick(std::mt19937 &rng, const Schedule &schedule) const;
+
+  const Graph &graph;
+  Device device;
+  bool compact;
+  std::vector<int> droplets;
+  int rounds;
+  int improvements;
+};
+
+#endif
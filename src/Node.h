@@ -24,17 +24,19 @@
 enum NodeType { INVALID, DISPENSE, MIX, OUTPUT, DETECT };
 
 struct Node {
-  int id;
-  NodeType type;
+  int id = 0;
+  NodeType type = INVALID;
   std::string label;
 
   // MIX
-  int time;
-  int drops;
+  int time = 0;
+  int drops = 0;
 
   // DISPENSE
   std::string fluid_name;
-  int volume;
+  int fluid = -1;  // index among the distinct fluid names, -1 for other nodes
+  int volume = 0;
+  int release = 0;  // earliest step to dispense, 0 for any
 
   // OUTPUT
   std::string sink_name;
@@ -0,0 +1,446 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Online.h"
+#include <z3++.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+#include "Heuristic.h"
+#include "Solver.h"
+#include "Verifier.h"
+
+using namespace z3;
+using namespace std;
+using namespace std::chrono;
+
+Online::Online(const Graph &graph) : Online(graph, Options()) {}
+
+Online::Online(const Graph &graph, const Options &options)
+    : graph(graph), options(options), executed(0), replans(0),
+      first_actuation(0), fresh(graph.nodes.size(), false), stop(false),
+      running(nullptr) {
+  // the order it imposes need not hold for the steps already executed
+  this->graph.symmetric.clear();
+}
+
+const Graph &Online::get_graph() const { return graph; }
+
+const Schedule &Online::get_schedule() const { return schedule; }
+
+int Online::get_executed() const { return executed; }
+
+int Online::get_replans() const { return replans; }
+
+long long Online::get_first_actuation() const { return first_actuation; }
+
+void Online::attach(context *context) {
+  lock_guard<mutex> guard(lock);
+  running = context;
+}
+
+bool Online::run(const execute_type &execute, const detect_type &detect) {
+  auto start = steady_clock::now();
+  executed = 0;
+  replans = 0;
+  schedule = Schedule(options.width, options.height, 0, graph.nodes.size());
+  if (!replan()) {
+    return false;
+  }
+  while (executed < schedule.time) {
+    // a block ends with a detection so that its outcome is known before
+    // the droplet moves on
+    vector<int> detected(graph.nodes.size(), -1);
+    int from = executed + 1;
+    int to = min(schedule.time, executed + options.horizon);
+    for (int id = 0; id < graph.nodes.size(); id++) {
+      if (graph.nodes[id].type != DETECT) {
+        continue;
+      }
+      int t = 1;
+      while (t <= schedule.time && schedule.droplet[t][id].first == -1) {
+        t++;
+      }
+      detected[id] = t <= schedule.time ? t - 1 : -1;
+      if (from <= detected[id] && detected[id] < to) {
+        to = detected[id];
+      }
+    }
+    if (from == 1) {
+      first_actuation =
+          duration_cast<milliseconds>(steady_clock::now() - start).count();
+    }
+    executed = to;
+    Graph block_graph = graph;
+    Schedule block = schedule;
+    atomic<bool> done(false);
+    thread chip([&]() {
+      execute(block_graph, block, from, to);
+      done = true;
+    });
+    improve(done);
+    chip.join();
+
+    vector<pair<int, Outcome>> outcomes;
+    for (int id = 0; id < graph.nodes.size(); id++) {
+      if (graph.nodes[id].type == DETECT && detected[id] == to) {
+        outcomes.emplace_back(id, detect(graph.nodes[id]));
+      }
+    }
+    bool changed = false;
+    for (int k = 0; k < outcomes.size(); k++) {
+      if (outcomes[k].first == -1 || !apply(outcomes[k].first,
+                                            outcomes[k].second)) {
+        continue;
+      }
+      changed = true;
+      for (int j = k + 1; j < outcomes.size(); j++) {
+        if (outcomes[j].first != -1) {
+          outcomes[j].first = renumber[outcomes[j].first];
+        }
+      }
+    }
+    if (changed) {
+      replans++;
+      if (!replan()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// shortens the schedule until the chip has executed the current block
+void Online::improve(atomic<bool> &done) {
+  atomic<bool> finished(false);
+  // an interrupt only stops a running check, so it is repeated until the
+  // search has noticed
+  thread watchdog([&]() {
+    while (!finished) {
+      this_thread::sleep_for(milliseconds(10));
+      if (done) {
+        stop = true;
+        lock_guard<mutex> guard(lock);
+        if (running) {
+          running->interrupt();
+        }
+      }
+    }
+  });
+  for (int steps = schedule.time - 1; steps > executed && !stop; steps--) {
+    Schedule shorter;
+    if (!solve(steps, options.timeout, shorter)) {
+      break;
+    }
+    schedule = shorter;
+  }
+  finished = true;
+  watchdog.join();
+  stop = false;
+}
+
+// A schedule that keeps the executed steps: the heuristic one, which the
+// chip can go on with at once and improve() shortens meanwhile, or else the
+// shortest z3 finds within the slack and the time limit.
+bool Online::replan() {
+  Heuristic heuristic(graph, options.width, options.height, options.device);
+  Schedule result;
+  if (heuristic.run(result, schedule, executed)) {
+    schedule = result;
+    return true;
+  }
+  auto deadline = steady_clock::now() + milliseconds(options.replan_timeout);
+  for (int steps = executed + 1; steps <= schedule.time + options.slack;
+       steps++) {
+    auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+    if (left.count() <= 0) {
+      break;
+    }
+    if (solve(steps, min<long long>(options.timeout, left.count()), result)) {
+      schedule = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Online::solve(int steps, unsigned timeout, Schedule &result) {
+  int n = graph.nodes.size();
+  Schedule base(options.width, options.height, steps, n);
+  for (int t = 1; t <= min(executed, schedule.time); t++) {
+    base.droplet[t] = schedule.droplet[t];
+    base.operation[t] = schedule.operation[t];
+  }
+  base.dispenser = schedule.dispenser;
+  base.sink = schedule.sink;
+  base.detector = schedule.detector;
+  // ports and detectors are built into the chip, only droplets added since
+  // get detectors of their own
+  bool sinks =
+      find(base.sink.begin(), base.sink.end(), true) != base.sink.end();
+  std::function<bool(int, int, int, int)> free = [&](int, int, int id,
+                                                     int t) {
+    if (t == 0) {
+      return id == -1 ? !sinks
+                      : fresh[id] && graph.nodes[id].type != DISPENSE;
+    }
+    return t > executed;
+  };
+  if (executed == 0) {
+    free = [](int, int, int, int) { return true; };
+  }
+
+  context ctx;
+  check_result answer = unknown;
+  try {
+    attach(&ctx);
+    Solver solver(ctx, graph, options.width, options.height, steps, 0,
+                  options.device);
+    // fixed variables as facts, as in LocalSearch
+    z3::solver plain(ctx);
+    plain.add(solver.get_constraints());
+    for (auto &literal : solver.fix(base, free)) {
+      plain.add(literal);
+    }
+    params p(ctx);
+    p.set("timeout", timeout);
+    plain.set(p);
+    if (!stop) {
+      answer = plain.check();
+    }
+    if (answer == sat) {
+      result = solver.extract(plain.get_model());
+    }
+  } catch (z3::exception e) {
+    // out of memory or interrupted
+    answer = unknown;
+  }
+  attach(nullptr);
+  Verifier verifier(graph, options.device);
+  if (answer != sat || !verifier.verify(result)) {
+    return false;
+  }
+  // the executed steps stay as the chip ran them
+  verifier.trim(result, executed + 1);
+  return true;
+}
+
+bool Online::appeared(int id) const {
+  for (int t = 1; t <= min(executed, schedule.time); t++) {
+    if (schedule.droplet[t][id].first != -1 ||
+        !schedule.operation[t][id].empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// whether droplets a and b kept clear of each other in the executed steps,
+// as they must once they no longer merge
+bool Online::apart(int a, int b) const {
+  auto near = [&](int t, int u) {
+    auto &p = schedule.droplet[t][a], &q = schedule.droplet[u][b];
+    return p.first != -1 && q.first != -1 &&
+           abs(p.first - q.first) <= 1 && abs(p.second - q.second) <= 1;
+  };
+  for (int t = 1; t <= min(executed, schedule.time); t++) {
+    if (near(t, t) || near(t, t - 1) || near(t - 1, t)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Edits the graph for the outcome of detection id. Nodes that already
+// started stay, so an outcome comes too late once the consumers of the
+// detected droplet have, or once it closed in on droplets to merge with.
+bool Online::apply(int id, Outcome outcome) {
+  int n = graph.nodes.size();
+  vector<int> consumers;
+  for (auto &edge : graph.edges) {
+    if (edge.first == id && graph.nodes[edge.second].type != OUTPUT) {
+      if (appeared(edge.second)) {
+        return false;
+      }
+      consumers.push_back(edge.second);
+    }
+  }
+  if (outcome == PASS || consumers.empty()) {
+    return false;
+  }
+
+  string sink_name = "output";
+  for (auto &node : graph.nodes) {
+    if (node.type == OUTPUT) {
+      sink_name = node.sink_name;
+    }
+  }
+  vector<Node> added;
+  vector<pair<int, int>> edges;
+  auto add = [&](const Node &node, const char *suffix) {
+    added.push_back(node);
+    added.back().id = n + added.size() - 1;
+    added.back().label += suffix;
+    return added.back().id;
+  };
+  auto to_sink = [&](int from) {
+    Node output = Node();
+    output.type = OUTPUT;
+    output.label = graph.nodes[from].label;
+    output.sink_name = sink_name;
+    output.fluid = -1;
+    edges.emplace_back(from, add(output, "_out"));
+  };
+
+  vector<bool> removed(n, false), kept(n, false);
+  if (outcome == DISCARD) {
+    // what was to be made of the droplet, then what only fed it
+    vector<int> stack = consumers;
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      if (removed[node]) {
+        continue;
+      }
+      if (appeared(node)) {
+        return false;
+      }
+      removed[node] = true;
+      for (auto &edge : graph.edges) {
+        if (edge.first == node) {
+          stack.push_back(edge.second);
+        }
+      }
+    }
+    vector<int> stay;
+    bool more = true;
+    while (more) {
+      more = false;
+      for (auto &edge : graph.edges) {
+        int from = edge.first;
+        if (!removed[edge.second] || removed[from] || kept[from]) {
+          continue;
+        }
+        if (appeared(from)) {
+          kept[from] = true;
+          stay.push_back(from);
+          to_sink(from);
+        } else {
+          removed[from] = true;
+        }
+        more = true;
+      }
+    }
+    for (int a = 0; a < stay.size(); a++) {
+      for (int b = a + 1; b < stay.size(); b++) {
+        if (!apart(stay[a], stay[b])) {
+          return false;
+        }
+      }
+    }
+  } else {
+    for (auto &edge : graph.edges) {
+      bool partner = edge.first != id &&
+                     find(consumers.begin(), consumers.end(), edge.second) !=
+                         consumers.end();
+      if (partner && !apart(id, edge.first)) {
+        return false;
+      }
+    }
+    // a copy of everything that led to the droplet takes its place
+    vector<int> copy(n, -1);
+    vector<int> stack(1, id);
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      if (copy[node] == -1) {
+        Node node_copy = graph.nodes[node];
+        node_copy.release = 0;
+        copy[node] = add(node_copy, "_again");
+        for (auto &edge : graph.edges) {
+          if (edge.second == node) {
+            stack.push_back(edge.first);
+          }
+        }
+      }
+    }
+    for (auto &edge : graph.edges) {
+      if (copy[edge.second] != -1) {
+        edges.emplace_back(copy[edge.first], copy[edge.second]);
+      }
+    }
+    for (int consumer : consumers) {
+      edges.emplace_back(copy[id], consumer);
+    }
+    to_sink(id);
+  }
+  for (auto &edge : graph.edges) {
+    bool moved = edge.first == id && find(consumers.begin(), consumers.end(),
+                                          edge.second) != consumers.end();
+    if (!moved) {
+      edges.push_back(edge);
+    }
+  }
+  edit(removed, added, edges);
+  return true;
+}
+
+void Online::edit(const vector<bool> &removed, const vector<Node> &added,
+                  const vector<pair<int, int>> &edges) {
+  int n = graph.nodes.size();
+  renumber.assign(n + added.size(), -1);
+  vector<Node> nodes;
+  for (int i = 0; i < n + added.size(); i++) {
+    if (i < n && removed[i]) {
+      continue;
+    }
+    renumber[i] = nodes.size();
+    nodes.push_back(i < n ? graph.nodes[i] : added[i - n]);
+    nodes.back().id = renumber[i];
+  }
+  graph.nodes = nodes;
+  graph.edges.clear();
+  for (auto &edge : edges) {
+    if (renumber[edge.first] != -1 && renumber[edge.second] != -1) {
+      graph.edges.emplace_back(renumber[edge.first], renumber[edge.second]);
+    }
+  }
+  graph.num_output = max(graph.num_output, added.empty() ? 0 : 1);
+  graph.index_fluids();
+
+  Schedule result(schedule.width, schedule.height, schedule.time,
+                  nodes.size());
+  result.sink = schedule.sink;
+  vector<bool> was_fresh = fresh;
+  fresh.assign(nodes.size(), true);
+  for (int i = 0; i < n; i++) {
+    int j = renumber[i];
+    if (j == -1) {
+      continue;
+    }
+    for (int t = 0; t <= schedule.time; t++) {
+      result.droplet[t][j] = schedule.droplet[t][i];
+      result.operation[t][j] = schedule.operation[t][i];
+    }
+    result.dispenser[j] = schedule.dispenser[i];
+    result.detector[j] = schedule.detector[i];
+    fresh[j] = was_fresh[i];
+  }
+  schedule = result;
+  renumber.resize(n);
+}
@@ -0,0 +1,104 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ONLINE_H__
+#define __ONLINE_H__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "Device.h"
+#include "Graph.h"
+#include "Schedule.h"
+
+namespace z3 {
+class context;
+}
+
+// Synthesis while the chip runs. There is always a whole schedule: first
+// the one of Heuristic, then shorter ones z3 finds with the steps already
+// handed to the chip fixed. Steps go to the chip a block of horizon steps
+// at a time, and the next block is planned while one executes. Once a
+// block has run, the outcome of every detection in it may discard the
+// operations after it or repeat the operations that led to it, and the
+// rest of the assay is planned again from where the droplets are, by
+// Heuristic as well before z3 shortens it.
+class Online {
+ public:
+  struct Options {
+    int width = 5;
+    int height = 5;
+    Device device;
+    int horizon = 4;          // steps per block
+    unsigned timeout = 60000;  // ms per number of steps tried
+    unsigned replan_timeout = 300000;  // ms for all of them in a replan
+    int slack = 20;  // steps a plan may take beyond the one it replaces
+  };
+
+  enum Outcome {
+    PASS,     // the droplet goes on as planned
+    DISCARD,  // it goes to a sink, with what was to be made of it
+    REPEAT    // as DISCARD, then made again from fresh droplets
+  };
+
+  // runs steps from..to of the schedule on the chip, blocking
+  typedef std::function<void(const Graph &, const Schedule &, int, int)>
+      execute_type;
+  // the outcome of a DETECT node, once executed
+  typedef std::function<Outcome(const Node &)> detect_type;
+
+  explicit Online(const Graph &graph);
+  Online(const Graph &graph, const Options &options);
+  // false when no schedule completes the assay, the chip has then run
+  // get_schedule() up to get_executed()
+  bool run(const execute_type &execute, const detect_type &detect);
+  const Graph &get_graph() const;
+  const Schedule &get_schedule() const;
+  int get_executed() const;
+  int get_replans() const;
+  // ms from run() until the chip got its first block
+  long long get_first_actuation() const;
+
+ private:
+  void improve(std::atomic<bool> &done);
+  bool replan();
+  bool solve(int steps, unsigned timeout, Schedule &result);
+  bool apply(int id, Outcome outcome);
+  // nodes past the current ones are added, edges are the new ones
+  void edit(const std::vector<bool> &removed, const std::vector<Node> &added,
+            const std::vector<std::pair<int, int>> &edges);
+  bool appeared(int id) const;
+  bool apart(int a, int b) const;
+  void attach(z3::context *context);
+
+  Graph graph;
+  Options options;
+  Schedule schedule;
+  int executed;  // steps handed to the chip, fixed from now on
+  int replans;
+  long long first_actuation;
+  std::vector<bool> fresh;  // nodes added since the resources were placed
+  std::vector<int> renumber;  // node ids before the last edit to after, or -1
+  std::atomic<bool> stop;
+  std::mutex lock;
+  z3::context *running;
+};
+
+#endif
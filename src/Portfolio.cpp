@@ -0,0 +1,156 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Portfolio.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace z3;
+using namespace std;
+
+Portfolio::Portfolio(Solver &solver) : solver(solver) {}
+
+vector<Portfolio::Config> Portfolio::configs(int size) {
+  vector<Config> result = {
+      {"optimize", true, false, {}},
+      {"solver", false, false, {}},
+      {"arithmetic", false, true, {}},
+      {"geometric restarts", false, false,
+       {{"restart_strategy", "0"}, {"phase_selection", "0"}}},
+      {"random phase", false, false,
+       {{"random_seed", "1"}, {"phase_selection", "5"}}},
+      {"optimize without elim_01", true, false, {{"elim_01", "false"}}},
+      {"no relevancy", false, false, {{"relevancy", "0"}}},
+  };
+  char buffer[128];
+  for (int seed = 2; result.size() < size; seed++) {
+    sprintf(buffer, "seed %d", seed);
+    result.push_back(
+        Config{buffer, false, false, {{"random_seed", to_string(seed)}}});
+  }
+  result.resize(size);
+  return result;
+}
+
+check_result Portfolio::check(const vector<Config> &configs,
+                              Schedule &schedule, unsigned timeout,
+                              const atomic<bool> *stop) {
+  // z3 contexts are not thread safe, so every copy is translated up front
+  int n = configs.size();
+  vector<unique_ptr<context>> contexts;
+  vector<expr_vector> constraints;
+  vector<expr> objectives;
+  expr_vector original = solver.get_constraints();
+  expr_vector arithmetic = original;
+  for (auto &config : configs) {
+    if (config.arithmetic) {
+      arithmetic = solver.get_constraints(true);
+      break;
+    }
+  }
+  expr_vector objective(original.ctx());
+  objective.push_back(solver.get_objective());
+  for (int i = 0; i < n; i++) {
+    contexts.emplace_back(new context());
+    auto &ctx = *contexts.back();
+    constraints.emplace_back(ctx, configs[i].arithmetic ? arithmetic : original);
+    objectives.push_back(expr_vector(ctx, objective)[0]);
+  }
+
+  mutex lock;
+  vector<bool> finished(n, false);
+  atomic<int> first(-1);
+  check_result answer = unknown;
+  unique_ptr<model> best;
+  auto race = [&](int i) {
+    auto &ctx = *contexts[i];
+    check_result result = unknown;
+    unique_ptr<model> found;
+    try {
+      params p(ctx);
+      if (timeout) {
+        p.set("timeout", timeout);
+      }
+      if (configs[i].optimize) {
+        optimize opt(ctx);
+        opt.add(constraints[i]);
+        opt.minimize(objectives[i]);
+        Profile::apply(opt, configs[i].params);
+        opt.set(p);
+        result = first == -1 ? opt.check() : unknown;
+        if (result == sat) {
+          found.reset(new model(opt.get_model()));
+        }
+      } else {
+        z3::solver plain(ctx);
+        plain.add(constraints[i]);
+        Profile::apply(plain, configs[i].params);
+        plain.set(p);
+        result = first == -1 ? plain.check() : unknown;
+        if (result == sat) {
+          found.reset(new model(plain.get_model()));
+        }
+      }
+    } catch (z3::exception e) {
+      result = unknown;
+    }
+    lock_guard<mutex> guard(lock);
+    if (result != unknown && first == -1) {
+      first = i;
+      answer = result;
+      best = move(found);
+    }
+    finished[i] = true;
+  };
+
+  vector<thread> threads;
+  for (int i = 0; i < n; i++) {
+    threads.emplace_back(race, i);
+  }
+  // an interrupt only stops a running check, so repeat it until every
+  // thread has seen one
+  while (true) {
+    this_thread::sleep_for(chrono::milliseconds(10));
+    lock_guard<mutex> guard(lock);
+    if (find(finished.begin(), finished.end(), false) == finished.end()) {
+      break;
+    }
+    bool halt = first != -1 || (stop && *stop);
+    for (int i = 0; halt && i < n; i++) {
+      if (!finished[i]) {
+        contexts[i]->interrupt();
+      }
+    }
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  winner = first == -1 ? "" : configs[first].name;
+  if (answer == sat) {
+    model translated(*best, solver.get_solver().ctx(), model::translate());
+    schedule = solver.extract(translated);
+  }
+  return answer;
+}
+
+const string &Portfolio::get_winner() { return winner; }
@@ -0,0 +1,56 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __PORTFOLIO_H__
+#define __PORTFOLIO_H__
+
+#include <z3++.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "Profile.h"
+#include "Schedule.h"
+#include "Solver.h"
+
+// Races copies of the encoding of a solver in their own contexts, one
+// thread per configuration. The first definite answer wins and interrupts
+// the others.
+class Portfolio {
+ public:
+  struct Config {
+    std::string name;
+    bool optimize;    // minimize num_points, otherwise any schedule will do
+    bool arithmetic;  // cardinalities as integer sums
+    Profile::params_type params;
+  };
+
+  explicit Portfolio(Solver &solver);
+  // the first size of a fixed list of diverse configurations
+  static std::vector<Config> configs(int size);
+  // gives up with unknown once *stop is set
+  z3::check_result check(const std::vector<Config> &configs,
+                         Schedule &schedule, unsigned timeout = 0,
+                         const std::atomic<bool> *stop = nullptr);
+  const std::string &get_winner();
+
+ private:
+  Solver &solver;
+  std::string winner;
+};
+
+#endif
@@ -0,0 +1,146 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Profile.h"
+#include <fstream>
+#include <stdlib.h>
+#include "Graph.h"
+
+using namespace std;
+
+bool Profile::load(const char *file) {
+  ifstream in(file);
+  if (!in) {
+    return false;
+  }
+  while (!in.eof()) {
+    string line;
+    getline(in, line);
+    if (line.find('(') == string::npos)
+      continue;
+
+    string name(line, 0, line.find('('));
+    trim(name);
+
+    auto begin = line.find('(') + 1, next = string::npos;
+    vector<string> params;
+    while ((next = line.find_first_of(",)", begin)) != string::npos) {
+      string param(line, begin, next - begin);
+      trim(param);
+      params.push_back(param);
+      begin = next + 1;
+    }
+
+    if (name == "PROFILE" && params.size() == 1) {
+      // class tuned to the default parameters
+      entries[params[0]];
+    } else if (name == "PROFILE" && params.size() == 3) {
+      entries[params[0]].emplace_back(params[1], params[2]);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Profile::save(const char *file) const {
+  ofstream out(file);
+  for (auto &entry : entries) {
+    if (entry.second.empty()) {
+      out << "PROFILE (" << entry.first << ")" << endl;
+    }
+    for (auto &param : entry.second) {
+      out << "PROFILE (" << entry.first << ", " << param.first << ", "
+          << param.second << ")" << endl;
+    }
+  }
+}
+
+const Profile::params_type &Profile::get(const string &assay_class) const {
+  static const params_type empty;
+  auto it = entries.find(assay_class);
+  if (it == entries.end()) {
+    it = entries.find("default");
+  }
+  return it == entries.end() ? empty : it->second;
+}
+
+void Profile::set(const string &assay_class, const params_type &params) {
+  entries[assay_class] = params;
+}
+
+// typed as z3 expects it, e.g. a bool parameter rejects an unsigned value
+static void set_typed(z3::params &p, const string &name,
+                      const string &value) {
+  char *end = nullptr;
+  if (value == "true" || value == "false") {
+    p.set(name.c_str(), value == "true");
+  } else if (strtoul(value.c_str(), &end, 10), *end == '\0') {
+    p.set(name.c_str(), (unsigned)strtoul(value.c_str(), nullptr, 10));
+  } else if (strtod(value.c_str(), &end), *end == '\0') {
+    p.set(name.c_str(), strtod(value.c_str(), nullptr));
+  } else {
+    p.set(name.c_str(), p.ctx().str_symbol(value.c_str()));
+  }
+}
+
+Profile::params_type Profile::apply(z3::optimize &solver,
+                                    const params_type &params) {
+  params_type rejected;
+  for (auto &param : params) {
+    try {
+      z3::params p(solver.ctx());
+      set_typed(p, param.first, param.second);
+      solver.set(p);
+    } catch (z3::exception &e) {
+      // not an optimize parameter, e.g. smt.random_seed, which would only
+      // take effect as a global one for every solver of the process
+      rejected.push_back(param);
+    }
+  }
+  return rejected;
+}
+
+Profile::params_type Profile::unsupported(const params_type &params) {
+  z3::context c;
+  z3::optimize probe(c);
+  return apply(probe, params);
+}
+
+void Profile::apply(z3::solver &solver, const params_type &params) {
+  z3::params p(solver.ctx());
+  for (auto &param : params) {
+    set_typed(p, param.first, param.second);
+  }
+  solver.set(p);
+}
+
+string Profile::classify(const char *file) {
+  string path(file);
+  auto slash = path.rfind('/');
+  if (slash == string::npos) {
+    return "default";
+  }
+  path.erase(slash);
+  auto assays = path.find("Assays/");
+  if (assays != string::npos) {
+    return path.substr(assays + 7);
+  }
+  slash = path.rfind('/');
+  return slash == string::npos ? path : path.substr(slash + 1);
+}
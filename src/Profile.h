@@ -0,0 +1,53 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <z3++.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Solver parameters per assay class, e.g. PROFILE (B4/MixSplit, elim_01,
+// false). The class "default" applies to assays without an entry.
+class Profile {
+ public:
+  typedef std::vector<std::pair<std::string, std::string>> params_type;
+
+  bool load(const char *file);
+  void save(const char *file) const;
+  const params_type &get(const std::string &assay_class) const;
+  void set(const std::string &assay_class, const params_type &params);
+  // optimize takes only its own parameters, the others (smt.*, sat.*, ...)
+  // are left out and returned for the caller to report
+  static params_type apply(z3::optimize &solver, const params_type &params);
+  // the parameters apply() would leave out of an optimize
+  static params_type unsupported(const params_type &params);
+  // a plain solver takes the module parameters itself, without touching the
+  // global ones
+  static void apply(z3::solver &solver, const params_type &params);
+  // assay class of a file, the directory below testcase/Assays
+  static std::string classify(const char *file);
+
+ private:
+  std::map<std::string, params_type> entries;
+};
+
+#endif
@@ -0,0 +1,236 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Reduction.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+Reduction::Reduction(const Graph &graph) : reduced(graph), removed(0) {
+  prune(graph);
+  find_symmetry();
+}
+
+const Graph &Reduction::get_graph() const { return reduced; }
+
+int Reduction::get_removed() const { return removed; }
+
+int Reduction::get_symmetric() const { return swaps.size(); }
+
+// Keeps the nodes whose result is observed, the DETECT nodes and the
+// OUTPUT nodes that take a droplet, and everything that leads to them. The
+// rest costs variables and ports but changes no result.
+void Reduction::prune(const Graph &graph) {
+  int n = graph.nodes.size();
+  vector<bool> useful(n, false);
+  vector<int> stack;
+  for (auto &edge : graph.edges) {
+    if (graph.nodes[edge.second].type == OUTPUT && !useful[edge.second]) {
+      useful[edge.second] = true;
+      stack.push_back(edge.second);
+    }
+  }
+  for (auto &node : graph.nodes) {
+    if (node.type == DETECT && !useful[node.id]) {
+      useful[node.id] = true;
+      stack.push_back(node.id);
+    }
+  }
+  while (!stack.empty()) {
+    int id = stack.back();
+    stack.pop_back();
+    for (auto &edge : graph.edges) {
+      if (edge.second == id && !useful[edge.first]) {
+        useful[edge.first] = true;
+        stack.push_back(edge.first);
+      }
+    }
+  }
+
+  vector<int> renumber(n, -1);
+  reduced.nodes.clear();
+  reduced.edges.clear();
+  reduced.symmetric.clear();
+  reduced.num_output = 0;
+  for (int i = 0; i < n; i++) {
+    if (!useful[i]) {
+      removed++;
+      continue;
+    }
+    renumber[i] = reduced.nodes.size();
+    Node node = graph.nodes[i];
+    node.id = renumber[i];
+    reduced.num_output += node.type == OUTPUT;
+    reduced.nodes.push_back(node);
+  }
+  // sinks may already be shared among the OUTPUT nodes
+  reduced.num_output = min(reduced.num_output, graph.num_output);
+  reduced.index_fluids();
+  for (auto &edge : graph.edges) {
+    if (useful[edge.first] && useful[edge.second]) {
+      reduced.edges.emplace_back(renumber[edge.first], renumber[edge.second]);
+    }
+  }
+}
+
+// everything of a node and its inputs that the encoding depends on
+string Reduction::signature(int id) {
+  if (!signatures[id].empty()) {
+    return signatures[id];
+  }
+  auto &node = reduced.nodes[id];
+  ostringstream out;
+  out << node.type << ",";
+  if (node.type == MIX || node.type == DETECT) {
+    out << node.time << "," << node.drops;
+  } else if (node.type == DISPENSE) {
+    out << node.fluid_name << "," << node.volume << "," << max(1, node.release);
+  } else if (node.type == OUTPUT) {
+    out << node.sink_name;
+  }
+  vector<string> children;
+  for (int input : inputs[id]) {
+    children.push_back(signature(input));
+  }
+  sort(children.begin(), children.end());
+  out << "(";
+  for (auto &child : children) {
+    out << child << ";";
+  }
+  out << ")";
+  return signatures[id] = out.str();
+}
+
+// the nodes of the sub-DAG of id in canonical order, so that isomorphic
+// sub-DAGs list corresponding nodes at the same positions
+void Reduction::collect(int id, vector<int> &nodes) {
+  nodes.push_back(id);
+  for (int input : inputs[id]) {
+    collect(input, nodes);
+  }
+}
+
+void Reduction::find_symmetry() {
+  int n = reduced.nodes.size();
+  inputs.assign(n, vector<int>());
+  vector<int> consumers(n, 0);
+  for (auto &edge : reduced.edges) {
+    inputs[edge.second].push_back(edge.first);
+    consumers[edge.first]++;
+  }
+  // a droplet used twice would let sub-DAGs overlap
+  for (int count : consumers) {
+    if (count > 1) {
+      return;
+    }
+  }
+  signatures.assign(n, "");
+  for (int i = 0; i < n; i++) {
+    signature(i);
+  }
+  auto canonical = [&](int a, int b) {
+    return signatures[a] < signatures[b] ||
+           (signatures[a] == signatures[b] && a < b);
+  };
+  vector<int> roots;
+  for (int i = 0; i < n; i++) {
+    sort(inputs[i].begin(), inputs[i].end(), canonical);
+    if (consumers[i] == 0) {
+      roots.push_back(i);
+    }
+  }
+  sort(roots.begin(), roots.end(), canonical);
+
+  // siblings with the same signature, the inputs of a deeper node first
+  vector<int> order;
+  for (int i = 0; i < n; i++) {
+    order.push_back(i);
+  }
+  vector<int> depth(n, 0);
+  for (int i : roots) {
+    vector<int> stack(1, i);
+    while (!stack.empty()) {
+      int id = stack.back();
+      stack.pop_back();
+      for (int input : inputs[id]) {
+        depth[input] = depth[id] + 1;
+        stack.push_back(input);
+      }
+    }
+  }
+  stable_sort(order.begin(), order.end(),
+              [&](int a, int b) { return depth[a] > depth[b]; });
+  auto pair_up = [&](const vector<int> &siblings) {
+    for (int k = 0; k + 1 < siblings.size(); k++) {
+      int a = siblings[k], b = siblings[k + 1];
+      if (signatures[a] != signatures[b]) {
+        continue;
+      }
+      vector<int> first, second;
+      collect(a, first);
+      collect(b, second);
+      for (int j = 0; j < first.size(); j++) {
+        if (reduced.nodes[first[j]].type == DISPENSE) {
+          reduced.symmetric.emplace_back(first[j], second[j]);
+          swaps.emplace_back(first, second);
+          break;
+        }
+      }
+    }
+  };
+  for (int id : order) {
+    pair_up(inputs[id]);
+  }
+  pair_up(roots);
+}
+
+void Reduction::canonicalize(Schedule &schedule) const {
+  if (schedule.num_nodes != reduced.nodes.size()) {
+    return;
+  }
+  // first step a droplet is on the grid
+  auto appears = [&](int id) {
+    int t = 1;
+    while (t <= schedule.time && schedule.droplet[t][id].first == -1) {
+      t++;
+    }
+    return t;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int k = 0; k < swaps.size(); k++) {
+      auto &pair = reduced.symmetric[k];
+      if (appears(pair.first) <= appears(pair.second)) {
+        continue;
+      }
+      auto &first = swaps[k].first, &second = swaps[k].second;
+      for (int j = 0; j < first.size(); j++) {
+        int a = first[j], b = second[j];
+        for (int t = 0; t <= schedule.time; t++) {
+          swap(schedule.droplet[t][a], schedule.droplet[t][b]);
+          swap(schedule.operation[t][a], schedule.operation[t][b]);
+        }
+        swap(schedule.dispenser[a], schedule.dispenser[b]);
+        swap(schedule.detector[a], schedule.detector[b]);
+      }
+      changed = true;
+    }
+  }
+}
@@ -0,0 +1,56 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __REDUCTION_H__
+#define __REDUCTION_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "Graph.h"
+#include "Schedule.h"
+
+// Simplifies an assay before encoding. Nodes whose droplets never reach an
+// OUTPUT are dropped, and isomorphic sub-DAGs feeding the same operation,
+// or the same chip as whole assays, are found so that Solver only explores
+// one order of them.
+class Reduction {
+ public:
+  explicit Reduction(const Graph &graph);
+  const Graph &get_graph() const;
+  int get_removed() const;
+  int get_symmetric() const;
+  // swaps interchangeable sub-DAGs of a schedule of the reduced graph until
+  // it agrees with the symmetry breaking, e.g. for the heuristic schedule
+  void canonicalize(Schedule &schedule) const;
+
+ private:
+  void prune(const Graph &graph);
+  void find_symmetry();
+  std::string signature(int id);
+  void collect(int id, std::vector<int> &nodes);
+
+  Graph reduced;
+  int removed;
+  std::vector<std::vector<int>> inputs;
+  std::vector<std::string> signatures;
+  // corresponding nodes of interchangeable sub-DAGs, inner ones first
+  std::vector<std::pair<std::vector<int>, std::vector<int>>> swaps;
+};
+
+#endif
@@ -0,0 +1,454 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Schedule.h"
+#include <algorithm>
+#include <climits>
+#include <new>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "Graph.h"
+
+using namespace std;
+
+Schedule::Schedule() : width(0), height(0), time(0), num_nodes(0) {}
+
+Schedule::Schedule(int width, int height, int time, int num_nodes)
+    : width(width), height(height), time(time), num_nodes(num_nodes) {
+  droplet.resize(time + 1);
+  operation.resize(time + 1);
+  for (int t = 0; t <= time; t++) {
+    droplet[t].resize(num_nodes, cell_type(-1, -1));
+    operation[t].resize(num_nodes);
+  }
+  dispenser.resize(num_nodes, -1);
+  sink.resize(2 * (width + height), false);
+  detector.resize(num_nodes, cell_type(-1, -1));
+}
+
+// Same line format as the assay files, e.g. DROPLET (t, id, x, y)
+bool Schedule::load(const char *file) {
+  ifstream in(file);
+  if (!in) {
+    return false;
+  }
+  return load(in);
+}
+
+// a malformed line makes load() fail instead of throwing
+static bool parse_int(const string &text, int &value) {
+  char *end = nullptr;
+  long number = strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || number < INT_MIN || number > INT_MAX) {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+static bool in_range(int value, size_t size) {
+  return value >= 0 && value < (long long)size;
+}
+
+bool Schedule::load(istream &in) {
+  bool has_header = false;
+  while (!in.eof()) {
+    string line;
+    getline(in, line);
+    if (line.find('(') == string::npos)
+      continue;
+
+    string name(line, 0, line.find('('));
+    trim(name);
+
+    auto begin = line.find('(') + 1, next = string::npos;
+    vector<int> params;
+    while ((next = line.find_first_of(",)", begin)) != string::npos) {
+      string param(line, begin, next - begin);
+      trim(param);
+      int value;
+      if (!parse_int(param, value)) {
+        return false;
+      }
+      params.push_back(value);
+      begin = next + 1;
+    }
+
+    auto on_chip = [&](int x, int y) {
+      return in_range(x, width) && in_range(y, height);
+    };
+    if (name == "SCHEDULE" && params.size() == 4) {
+      if (params[0] <= 0 || params[1] <= 0 || params[2] < 0 ||
+          params[3] < 0) {
+        return false;
+      }
+      try {
+        *this = Schedule(params[0], params[1], params[2], params[3]);
+      } catch (bad_alloc &e) {
+        return false;
+      }
+      has_header = true;
+    } else if (!has_header) {
+      return false;
+    } else if (name == "DISPENSER" && params.size() == 2 &&
+               in_range(params[0], sink.size()) &&
+               in_range(params[1], num_nodes)) {
+      dispenser[params[1]] = params[0];
+    } else if (name == "SINK" && params.size() == 1 &&
+               in_range(params[0], sink.size())) {
+      sink[params[0]] = true;
+    } else if (name == "DETECTOR" && params.size() == 3 &&
+               on_chip(params[0], params[1]) &&
+               in_range(params[2], num_nodes)) {
+      detector[params[2]] = cell_type(params[0], params[1]);
+    } else if ((name == "DROPLET" || name == "OPERATION") &&
+               params.size() == 4 && in_range(params[0], time + 1) &&
+               in_range(params[1], num_nodes) &&
+               on_chip(params[2], params[3])) {
+      cell_type cell(params[2], params[3]);
+      if (name == "DROPLET") {
+        droplet[params[0]][params[1]] = cell;
+      } else {
+        operation[params[0]][params[1]].push_back(cell);
+      }
+    } else {
+      return false;
+    }
+  }
+  return has_header;
+}
+
+void Schedule::save(const char *file) const {
+  ofstream out(file);
+  save(out);
+}
+
+void Schedule::save(ostream &out) const {
+  out << "SCHEDULE (" << width << ", " << height << ", " << time << ", "
+      << num_nodes << ")" << endl;
+  for (int id = 0; id < num_nodes; id++) {
+    if (dispenser[id] != -1) {
+      out << "DISPENSER (" << dispenser[id] << ", " << id << ")" << endl;
+    }
+  }
+  for (int p = 0; p < sink.size(); p++) {
+    if (sink[p]) {
+      out << "SINK (" << p << ")" << endl;
+    }
+  }
+  for (int id = 0; id < num_nodes; id++) {
+    if (detector[id].first != -1) {
+      out << "DETECTOR (" << detector[id].first << ", " << detector[id].second
+          << ", " << id << ")" << endl;
+    }
+  }
+  for (int t = 1; t <= time; t++) {
+    for (int id = 0; id < num_nodes; id++) {
+      if (droplet[t][id].first != -1) {
+        out << "DROPLET (" << t << ", " << id << ", " << droplet[t][id].first
+            << ", " << droplet[t][id].second << ")" << endl;
+      }
+      for (auto &cell : operation[t][id]) {
+        out << "OPERATION (" << t << ", " << id << ", " << cell.first << ", "
+            << cell.second << ")" << endl;
+      }
+    }
+  }
+}
+
+bool Schedule::fits(const Graph &graph, int width, int height) const {
+  return this->width == width && this->height == height && time > 0 &&
+         num_nodes == graph.nodes.size();
+}
+
+Schedule Schedule::shift(int offset) const {
+  Schedule result(width, height, time + offset, num_nodes);
+  for (int t = 1; t <= time; t++) {
+    result.droplet[t + offset] = droplet[t];
+    result.operation[t + offset] = operation[t];
+  }
+  result.dispenser = dispenser;
+  result.sink = sink;
+  result.detector = detector;
+  return result;
+}
+
+int Schedule::num_points() const {
+  int result = 0;
+  for (int t = 1; t <= time; t++) {
+    for (int id = 0; id < num_nodes; id++) {
+      result += droplet[t][id].first != -1;
+      result += operation[t][id].size();
+    }
+  }
+  return result;
+}
+
+Schedule::cell_type Schedule::port_cell(int p) const {
+  int x = 0, y = 0;
+  if (p < width) {
+    y = p;
+  } else if (p < width + height) {
+    x = p - width;
+    y = width - 1;
+  } else if (p < width * 2 + height) {
+    x = height - 1;
+    y = width * 2 + height - p - 1;
+  } else {
+    x = (width + height) * 2 - p - 1;
+    y = 0;
+  }
+  return cell_type(x, y);
+}
+
+void Schedule::print(const Graph &graph) const {
+  auto operating = [&](int t, int id, int x, int y) {
+    auto &cells = operation[t][id];
+    return find(cells.begin(), cells.end(), cell_type(x, y)) != cells.end();
+  };
+
+  system("rm time*.png");
+  system("rm time*.dot");
+  for (int i = 0; i < graph.nodes.size(); i++) {
+    if (graph.nodes[i].type == DISPENSE) {
+      for (int j = 0; j < 2 * (width + height); j++) {
+        if (dispenser[i] == j) {
+          cout << "Dispenser at " << j << " of type " << i << endl;
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < 2 * (width + height); i++) {
+    if (sink[i]) {
+      cout << "Sink at " << i << endl;
+    }
+  }
+
+  for (int i = 0; i < height; i++) {
+    for (int j = 0; j < width; j++) {
+      for (int id = 0; id < graph.nodes.size(); id++) {
+        for (auto &edge : graph.edges) {
+          if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
+            if (detector[id] == cell_type(i, j)) {
+              cout << "Detect at (" << i << "," << j << ") of type " << id
+                   << endl;
+            }
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  vector<string> image_names;
+  for (int t = 1; t <= time; t++) {
+    char file_name[128];
+    sprintf(file_name, "time%d.dot", t);
+    char img_name[128];
+    sprintf(img_name, "time%d.png", t);
+    // wildcard is not lexigraphically sorted
+    image_names.push_back(img_name);
+    ofstream out(file_name);
+    out << "digraph step {rankdir=LR;node "
+           "[shape=record,fontname=\"Inconsolata\"];"
+        << endl;
+
+    // dispenser
+    out << "dispenser [label=\"Dispensers:|";
+    bool first_dispenser = true;
+    for (int i = 0; i < graph.nodes.size(); i++) {
+      if (graph.nodes[i].type == DISPENSE) {
+        for (int j = 0; j < 2 * (width + height); j++) {
+          if (dispenser[i] == j) {
+            if (first_dispenser) {
+              first_dispenser = false;
+            } else {
+              out << "|";
+            }
+            out << "<d" << j << ">" << i;
+          }
+        }
+      }
+    }
+    out << "\"];" << endl;
+
+    // sink
+    out << "sink [label=\"Sinks:|";
+    bool first_sink = true;
+    for (int j = 0; j < 2 * (width + height); j++) {
+      if (sink[j]) {
+        if (first_sink) {
+          first_sink = false;
+        } else {
+          out << "|";
+        }
+        out << "<s" << j << ">"
+            << "S";
+      }
+    }
+    out << "\"];" << endl;
+
+    // detector
+    out << "detector [label=\"Detectors:|";
+    bool first_detector = true;
+    for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+        for (int id = 0; id < graph.nodes.size(); id++) {
+          for (auto &edge : graph.edges) {
+            if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
+              if (detector[id] == cell_type(i, j)) {
+                if (first_detector) {
+                  first_detector = false;
+                } else {
+                  out << "|";
+                }
+                out << "<D" << i << j << ">" << id;
+              }
+              break;
+            }
+          }
+        }
+      }
+    }
+    out << "\"];" << endl;
+
+    out << "board [label=\"";
+    cout << "time: " << t << endl;
+    for (int i = 0; i < height; i++) {
+      if (i != 0) {
+        out << "|";
+      }
+      out << "{";
+      for (int j = 0; j < width; j++) {
+        out << "<f" << i << j << ">";
+
+        bool flag = false;
+        for (auto &node : graph.nodes) {
+          if (node.type == DISPENSE || node.type == MIX ||
+              node.type == DETECT) {
+            if (droplet[t][node.id] == cell_type(i, j)) {
+              cout << node.id << " ";
+              if (j != width - 1) {
+                out << node.id << "|";
+              } else {
+                out << node.id;
+              }
+              flag = true;
+            }
+          }
+        }
+        if (!flag) {
+          bool mixing_or_detecting = false;
+          for (int id = 0; id < graph.nodes.size(); id++) {
+            if (graph.nodes[id].type == DETECT || graph.nodes[id].type == MIX) {
+              if (operating(t, id, i, j)) {
+                mixing_or_detecting = true;
+                if (graph.nodes[id].type == MIX)
+                  cout << "M ";
+                else
+                  cout << "D ";
+                if (j != width - 1) {
+                  if (graph.nodes[id].type == MIX)
+                    out << "M"
+                        << "|";
+                  else
+                    out << "D"
+                        << "|";
+                } else {
+                  if (graph.nodes[id].type == MIX)
+                    out << "M";
+                  else
+                    out << "D";
+                }
+                break;
+              }
+            }
+          }
+          if (!mixing_or_detecting) {
+            cout << "* ";
+            if (j != width - 1) {
+              out << "E"
+                  << "|";
+            } else {
+              out << "E";
+            }
+          }
+        }
+      }
+      out << "}";
+      cout << endl;
+    }
+    cout << endl;
+    out << "\"];" << endl;
+
+    // dispensers
+    for (int i = 0; i < graph.nodes.size(); i++) {
+      if (graph.nodes[i].type == DISPENSE) {
+        for (int j = 0; j < 2 * (width + height); j++) {
+          if (dispenser[i] == j) {
+            auto cell = port_cell(j);
+            out << "dispenser:d" << j << " -> board:f" << cell.first
+                << cell.second << endl;
+          }
+        }
+      }
+    }
+
+    // sink
+    for (int j = 0; j < 2 * (width + height); j++) {
+      if (sink[j]) {
+        auto cell = port_cell(j);
+        out << "sink:s" << j << " -> board:f" << cell.first << cell.second
+            << endl;
+      }
+    }
+
+    // detect
+    for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+        for (int id = 0; id < graph.nodes.size(); id++) {
+          for (auto &edge : graph.edges) {
+            if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
+              if (detector[id] == cell_type(i, j)) {
+                out << "detector:D" << i << j << " -> board:f" << i << j
+                    << endl;
+              }
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    out << "}" << endl;
+    out.close();
+    char cmd_line[128];
+    sprintf(cmd_line, "dot -Tpng -o %s %s", img_name, file_name);
+    system(cmd_line);
+  }
+  string cmd_line = "convert -delay 50 -loop 0";
+  for (auto &file : image_names) {
+    cmd_line += " " + file;
+  }
+  cmd_line += " animation.gif";
+  system(cmd_line.c_str());
+}
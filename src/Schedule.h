@@ -0,0 +1,69 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+
+class Graph;
+
+// A complete assignment of the synthesis variables, independent of any
+// z3::context. Cells are (x, y) with 0 <= x < height, 0 <= y < width, the
+// same layout as c_{x,y,i}^t in Solver. Time steps are numbered from 1.
+struct Schedule {
+  typedef std::pair<int, int> cell_type;
+
+  Schedule();
+  Schedule(int width, int height, int time, int num_nodes);
+
+  // false on a missing or malformed file
+  bool load(const char *file);
+  bool load(std::istream &in);
+  void save(const char *file) const;
+  void save(std::ostream &out) const;
+  // whether it is for the nodes of graph on a grid of that size
+  bool fits(const Graph &graph, int width, int height) const;
+  // delay every droplet by offset steps, extending the schedule
+  Schedule shift(int offset) const;
+  // cell adjacent to port p outside of the grid
+  cell_type port_cell(int p) const;
+  void print(const Graph &graph) const;
+  // cells of droplets and operations summed over time, the objective of
+  // Solver
+  int num_points() const;
+
+  int width;
+  int height;
+  int time;
+  int num_nodes;
+  // droplet[t][id]: cell of droplet id at time t, or (-1, -1)
+  std::vector<std::vector<cell_type>> droplet;
+  // operation[t][id]: cells occupied by mixing/detecting node id at time t
+  std::vector<std::vector<std::vector<cell_type>>> operation;
+  // dispenser[id]: port of dispense node id, or -1
+  std::vector<int> dispenser;
+  // sink[p]: whether port p is a sink
+  std::vector<bool> sink;
+  // detector[id]: cell of the detector for fluid id, or (-1, -1)
+  std::vector<cell_type> detector;
+};
+
+#endif
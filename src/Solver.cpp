@@ -17,8 +17,11 @@
 //
 
 #include "Solver.h"
+#include <algorithm>
 #include <fstream>
+#include <stdexcept>
 #include <stdio.h>
+#include <stdlib.h>
 
 using namespace z3;
 using namespace std;
@@ -26,26 +29,50 @@ using namespace std;
 const int neigh[][2] = {{-1, 0}, {0, -1}, {1, 0}, {0, 1}, {0, 0}};
 
 Solver::Solver(context &ctx, const Graph &graph, int width, int height,
-               int time)
-    : solver(ctx), num_points_handle(0), width(width), height(height),
-      time(time), graph(graph), num_points(ctx) {
+               int time, int track_window, const Device &device,
+               bool compact, bool lazy, int stride)
+    : solver(ctx), num_points(ctx), num_points_handle(0), width(width),
+      height(height), time(time), graph(graph), mixers(device.mixers),
+      compact(compact), lazy(lazy), refinements(0), stride(stride),
+      track_window(track_window) {
+  if (stride < 1) {
+    throw logic_error("Stride should be at least one step");
+  }
   char buffer[512];
   expr dummy(ctx);
   c.resize(height);
   dispenser.resize(2 * (height + width));
   sink.resize(2 * (height + width), dummy);
   for (int i = 0; i < 2 * (height + width); i++) {
-    dispenser[i].resize(graph.nodes.size(), dummy);
+    dispenser[i].resize(graph.num_dispenser, dummy);
     sprintf(buffer, "sink_p%d", i);
     sink[i] = ctx.bool_const(buffer);
-    for (int j = 0; j < graph.nodes.size(); j++) {
+    for (int j = 0; j < graph.num_dispenser; j++) {
       sprintf(buffer, "dispenser_p%d_l%d", i, j);
       dispenser[i][j] = ctx.bool_const(buffer);
     }
   }
+  // shape of each mixing operation, only a choice with several mixers
+  if (mixers.size() > 1) {
+    mixer.resize(graph.nodes.size());
+    for (auto &node : graph.nodes) {
+      if (node.type == MIX) {
+        for (int s = 0; s < mixers.size(); s++) {
+          sprintf(buffer, "mixer_i%d_s%d", node.id, s);
+          mixer[node.id].push_back(ctx.bool_const(buffer));
+        }
+      }
+    }
+  }
   expr_vector all_points(ctx);
   expr zero = ctx.int_val(0);
   expr one = ctx.int_val(1);
+  // only the droplets some DETECT node consumes get a detector
+  detected.assign(graph.nodes.size(), false);
+  for (auto &edge : graph.edges) {
+    detected[edge.first] = detected[edge.first] ||
+                           graph.nodes[edge.second].type == DETECT;
+  }
   detector.resize(height);
   for (int i = 0; i < height; i++) {
     c[i].resize(width);
@@ -55,8 +82,10 @@ Solver::Solver(context &ctx, const Graph &graph, int width, int height,
       c[i][j].resize(graph.nodes.size() * 2);
       detector[i][j].resize(graph.nodes.size(), dummy);
       for (int id = 0; id < graph.nodes.size(); id++) {
-        sprintf(buffer, "detector_x%d_y%d_i%d", i, j, id);
-        detector[i][j][id] = ctx.bool_const(buffer);
+        if (detected[id]) {
+          sprintf(buffer, "detector_x%d_y%d_i%d", i, j, id);
+          detector[i][j][id] = ctx.bool_const(buffer);
+        }
 
         // mixing/detecting nodes
         c[i][j][graph.nodes.size() + id].resize(time + 1, dummy);
@@ -95,7 +124,10 @@ Solver::Solver(context &ctx, const Graph &graph, int width, int height,
   add_consistency(ctx);
   add_placement(ctx);
   add_movement(ctx);
-  add_fluidic_constraint(ctx);
+  if (!lazy) {
+    add_fluidic_constraint(ctx);
+  }
+  add_symmetry(ctx);
 }
 
 optimize &Solver::get_solver() { return solver; }
@@ -103,262 +135,487 @@ int Solver::get_num_points() {
   return solver.lower(num_points_handle).get_numeral_int();
 }
 
-void Solver::print(const model &model) {
-  system("rm time*.png");
-  system("rm time*.dot");
-  for (int i = 0; i < graph.nodes.size(); i++) {
-    if (graph.nodes[i].type == DISPENSE) {
-      for (int j = 0; j < 2 * (width + height); j++) {
-        if (model.eval(dispenser[j][i]).bool_value() == Z3_L_TRUE) {
-          cout << "Dispenser at " << j << " of type " << i << endl;
-        }
+expr_vector Solver::get_constraints(bool arithmetic) {
+  // copies solve on their own without refining, so they get everything
+  if (lazy) {
+    add_fluidic_constraint(solver.ctx());
+    lazy = false;
+  }
+  expr_vector result(solver.ctx());
+  map<unsigned, expr> cache;
+  auto assertions = solver.assertions();
+  for (unsigned i = 0; i < assertions.size(); i++) {
+    result.push_back(arithmetic ? Solver::arithmetic(assertions[i], cache)
+                                : assertions[i]);
+  }
+  for (auto &guard : guard_literals) {
+    result.push_back(guard);
+  }
+  return result;
+}
+
+expr Solver::get_objective() { return num_points; }
+
+Solver::Estimate Solver::estimate(const Graph &graph, int width, int height,
+                                  int time, const Device &device,
+                                  bool compact, bool lazy) {
+  long long cells = width * height;
+  long long ports = 2 * (width + height), steps = time;
+  long long droplets = 0, regions = 0, mixes = 0, sources = 0;
+  for (auto &node : graph.nodes) {
+    droplets += node.type == DISPENSE || node.type == MIX ||
+                node.type == DETECT;
+    regions += node.type == MIX || node.type == DETECT;
+    mixes += node.type == MIX;
+    sources += node.type == DISPENSE || node.type == MIX;
+  }
+  long long fluids = graph.num_dispenser, detected = 0, outputs = 0;
+  for (auto &edge : graph.edges) {
+    detected += graph.nodes[edge.second].type == DETECT;
+    outputs += graph.nodes[edge.second].type == OUTPUT;
+  }
+
+  Estimate result{0, 0, 0, 0};
+  auto count = [&](long long constraints, long long literals) {
+    result.constraints += constraints;
+    result.literals += constraints * literals;
+  };
+  result.variables = 1 + ports + ports * fluids + cells * detected +
+                     cells * steps * (droplets + regions);
+  count(1, 3 * cells * steps * (droplets + regions));
+
+  // consistency and placement
+  count(cells * steps, sources + regions);
+  count(droplets * steps, cells);
+  count(ports, 1 + fluids);
+  count(cells, detected);
+  count(droplets, steps * cells);
+  count(detected, cells);
+  count(2 * fluids + 2, ports);
+  if (device.mixers.size() > 1) {
+    result.variables += mixes * device.mixers.size();
+    count(2 * mixes, device.mixers.size());
+  }
+
+  // movement, and the placements of every mixing operation
+  count(2 * cells * steps * droplets, 10);
+  for (auto &node : graph.nodes) {
+    if (node.type == MIX) {
+      long long inputs = 0;
+      for (auto &edge : graph.edges) {
+        inputs += edge.second == node.id;
       }
+      long long placements = 0;
+      for (auto &mixer : device.mixers) {
+        long long footprints = mixer.footprints().size();
+        long long area = mixer.rows * mixer.cols;
+        placements += cells * steps * footprints;
+        count(cells * steps * footprints, 2 + area * mixer.duration(node.time));
+      }
+      // inputs, their consumption, the output and the mixer of a placement
+      count(placements * inputs, 7);
+      count(placements * inputs, 3);
+      count(placements * (device.mixers.size() > 1 ? 2 : 1), 2);
+      count(2, placements);
+      count(cells, 3);
+      count(inputs * steps, cells);
+      result.variables += placements + cells;
     }
   }
+  count(outputs * cells * steps, 12);
+  count(graph.symmetric.size() * steps, cells * steps);
 
-  for (int i = 0; i < 2 * (width + height); i++) {
-    if (model.eval(sink[i]).bool_value() == Z3_L_TRUE) {
-      cout << "Sink at " << i << endl;
+  // fluidic constraints of every droplet pair on adjacent cells
+  long long adjacent = (3ll * height - 2) * (3ll * width - 2);
+  long long pairs = droplets * (droplets - 1);
+  long long windows = max(0ll, steps - 1) + max(0ll, steps - 2);
+  if (lazy) {
+    // usually a few groups, grown by check()
+  } else if (compact) {
+    result.variables += droplets * steps * (1 + cells);
+    count(droplets * steps, cells + 3);
+    count(droplets * steps * cells, 12);
+    count(cells * pairs * windows, 7);
+  } else {
+    count(adjacent * pairs * windows, 6);
+    count(pairs * windows, 2 * cells);
+  }
+
+  // fitted to the peak memory of z3 4.8 on the B2 assays over the first
+  // seconds of search, memory keeps growing slowly after that
+  result.bytes = (64ll << 20) + 110 * result.literals;
+  return result;
+}
+
+long long Solver::get_memory() {
+  auto stats = solver.statistics();
+  for (unsigned i = 0; i < stats.size(); i++) {
+    if (stats.key(i) == "max memory") {
+      return (long long)(stats.double_value(i) * 1024 * 1024);
     }
   }
+  return Z3_get_estimated_alloc_size();
+}
+
+Schedule Solver::extract(const model &model) {
+  Schedule schedule(width, height, time, graph.nodes.size());
+  for (int j = 0; j < 2 * (width + height); j++) {
+    schedule.sink[j] = model.eval(sink[j]).bool_value() == Z3_L_TRUE;
+  }
 
   for (int i = 0; i < height; i++) {
     for (int j = 0; j < width; j++) {
       for (int id = 0; id < graph.nodes.size(); id++) {
-        for (auto &edge : graph.edges) {
-          if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
-            if (model.eval(detector[i][j][id]).bool_value() == Z3_L_TRUE) {
-              cout << "Detect at (" << i << "," << j << ") of type " << id
-                   << endl;
+        if (detected[id] && schedule.detector[id].first == -1 &&
+            model.eval(detector[i][j][id]).bool_value() == Z3_L_TRUE) {
+          schedule.detector[id] = Schedule::cell_type(i, j);
+        }
+        auto type = graph.nodes[id].type;
+        for (int t = 1; t <= time; t++) {
+          if (type == DISPENSE || type == MIX || type == DETECT) {
+            if (model.eval(c[i][j][id][t]).bool_value() == Z3_L_TRUE) {
+              schedule.droplet[t][id] = Schedule::cell_type(i, j);
             }
-            break;
           }
-        }
-      }
-    }
-  }
-
-  vector<string> image_names;
-  for (int t = 1; t <= time; t++) {
-    char file_name[128];
-    sprintf(file_name, "time%d.dot", t);
-    char img_name[128];
-    sprintf(img_name, "time%d.png", t);
-    // wildcard is not lexigraphically sorted
-    image_names.push_back(img_name);
-    ofstream out(file_name);
-    out << "digraph step {rankdir=LR;node "
-           "[shape=record,fontname=\"Inconsolata\"];"
-        << endl;
-
-    // dispenser
-    out << "dispenser [label=\"Dispensers:|";
-    bool first_dispenser = true;
-    for (int i = 0; i < graph.nodes.size(); i++) {
-      if (graph.nodes[i].type == DISPENSE) {
-        for (int j = 0; j < 2 * (width + height); j++) {
-          if (model.eval(dispenser[j][i]).bool_value() == Z3_L_TRUE) {
-            if (first_dispenser) {
-              first_dispenser = false;
-            } else {
-              out << "|";
+          if (type == MIX || type == DETECT) {
+            if (model.eval(c[i][j][graph.nodes.size() + id][t])
+                    .bool_value() == Z3_L_TRUE) {
+              schedule.operation[t][id].emplace_back(i, j);
             }
-            out << "<d" << j << ">" << i;
           }
         }
       }
     }
-    out << "\"];" << endl;
-
-    // sink
-    out << "sink [label=\"Sinks:|";
-    bool first_sink = true;
+  }
+  // a droplet comes from a port of its fluid next to where it appears
+  for (int i = 0; i < graph.nodes.size(); i++) {
+    if (graph.nodes[i].type != DISPENSE) {
+      continue;
+    }
+    int t = 1;
+    while (t < time && schedule.droplet[t][i].first == -1) {
+      t++;
+    }
     for (int j = 0; j < 2 * (width + height); j++) {
-      if (model.eval(sink[j]).bool_value() == Z3_L_TRUE) {
-        if (first_sink) {
-          first_sink = false;
-        } else {
-          out << "|";
-        }
-        out << "<s" << j << ">"
-            << "S";
+      if (schedule.port_cell(j) == schedule.droplet[t][i] &&
+          model.eval(dispenser[j][graph.nodes[i].fluid]).bool_value() ==
+              Z3_L_TRUE) {
+        schedule.dispenser[i] = j;
+        break;
       }
     }
-    out << "\"];" << endl;
-
-    // detector
-    out << "detector [label=\"Detectors:|";
-    bool first_detector = true;
-    for (int i = 0; i < height; i++) {
-      for (int j = 0; j < width; j++) {
-        for (int id = 0; id < graph.nodes.size(); id++) {
-          for (auto &edge : graph.edges) {
-            if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
-              if (model.eval(detector[i][j][id]).bool_value() == Z3_L_TRUE) {
-                if (first_detector) {
-                  first_detector = false;
-                } else {
-                  out << "|";
-                }
-                out << "<D" << i << j << ">" << id;
-              }
-              break;
-            }
-          }
+  }
+  // nothing forbids spare detectors for a fluid, keep the one where its
+  // detected droplet appears
+  for (auto &edge : graph.edges) {
+    if (graph.nodes[edge.second].type != DETECT) {
+      continue;
+    }
+    for (int t = 1; t <= time; t++) {
+      auto cell = schedule.droplet[t][edge.second];
+      if (cell.first != -1) {
+        if (model.eval(detector[cell.first][cell.second][edge.first])
+                .bool_value() == Z3_L_TRUE) {
+          schedule.detector[edge.first] = cell;
         }
+        break;
       }
     }
-    out << "\"];" << endl;
+  }
+  return schedule;
+}
 
-    out << "board [label=\"";
-    cout << "time: " << t << endl;
-    for (int i = 0; i < height; i++) {
-      if (i != 0) {
-        out << "|";
+void Solver::set_initial_values(const Schedule &schedule) {
+  initial_values = fix(schedule);
+}
+
+vector<expr> Solver::fix(const Schedule &schedule,
+                         const std::function<bool(int, int, int, int)> &free,
+                         bool regions) {
+  if (schedule.width != width || schedule.height != height ||
+      schedule.time != time || schedule.num_nodes != graph.nodes.size()) {
+    throw logic_error("Schedule does not match the solver dimensions");
+  }
+  vector<expr> result;
+  auto literal = [](const expr &var, bool value) { return value ? var : !var; };
+  // the ports of a fluid are free when that of any of its dispensers is
+  vector<vector<bool>> ports(graph.num_dispenser,
+                             vector<bool>(2 * (width + height), false));
+  vector<bool> open(graph.num_dispenser, false);
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE) {
+      if (schedule.dispenser[node.id] != -1) {
+        ports[node.fluid][schedule.dispenser[node.id]] = true;
       }
-      out << "{";
-      for (int j = 0; j < width; j++) {
-        out << "<f" << i << j << ">";
+      open[node.fluid] = open[node.fluid] || (free && free(-1, -1, node.id, 0));
+    }
+  }
+  for (int j = 0; j < 2 * (width + height); j++) {
+    for (int f = 0; f < graph.num_dispenser; f++) {
+      if (!open[f]) {
+        result.push_back(literal(dispenser[j][f], ports[f][j]));
+      }
+    }
+    if (!free || !free(-1, -1, -1, 0)) {
+      result.push_back(literal(sink[j], schedule.sink[j]));
+    }
+  }
 
-        bool flag = false;
-        for (auto &node : graph.nodes) {
-          if (node.type == DISPENSE || node.type == MIX ||
-              node.type == DETECT) {
-            if (model.eval(c[i][j][node.id][t]).bool_value() == Z3_L_TRUE) {
-              cout << node.id << " ";
-              if (j != width - 1) {
-                out << node.id << "|";
-              } else {
-                out << node.id;
-              }
-              flag = true;
-            }
-          }
+  for (int i = 0; i < height; i++) {
+    for (int j = 0; j < width; j++) {
+      Schedule::cell_type cell(i, j);
+      for (int id = 0; id < graph.nodes.size(); id++) {
+        if (detected[id] && (!free || !free(i, j, id, 0))) {
+          result.push_back(
+              literal(detector[i][j][id], schedule.detector[id] == cell));
         }
-        if (!flag) {
-          bool mixing_or_detecting = false;
-          for (int id = 0; id < graph.nodes.size(); id++) {
-            if (graph.nodes[id].type == DETECT || graph.nodes[id].type == MIX) {
-              if (model.eval(c[i][j][graph.nodes.size() + id][t])
-                      .bool_value() == Z3_L_TRUE) {
-                mixing_or_detecting = true;
-                if (graph.nodes[id].type == MIX)
-                  cout << "M ";
-                else
-                  cout << "D ";
-                if (j != width - 1) {
-                  if (graph.nodes[id].type == MIX)
-                    out << "M"
-                        << "|";
-                  else
-                    out << "D"
-                        << "|";
-                } else {
-                  if (graph.nodes[id].type == MIX)
-                    out << "M";
-                  else
-                    out << "D";
-                }
-                break;
-              }
-            }
-          }
-          if (!mixing_or_detecting) {
-            cout << "* ";
-            if (j != width - 1) {
-              out << "E"
-                  << "|";
-            } else {
-              out << "E";
-            }
+        auto type = graph.nodes[id].type;
+        for (int t = 1; t <= time; t++) {
+          if (free && free(i, j, id, t)) {
+            continue;
           }
-        }
-      }
-      out << "}";
-      cout << endl;
-    }
-    cout << endl;
-    out << "\"];" << endl;
-
-    // dispensers
-    for (int i = 0; i < graph.nodes.size(); i++) {
-      if (graph.nodes[i].type == DISPENSE) {
-        for (int j = 0; j < 2 * (width + height); j++) {
-          int x = 0, y = 0;
-          if (j < width) {
-            y = j;
-          } else if (j < width + height) {
-            x = j - width;
-            y = width - 1;
-          } else if (j < width * 2 + height) {
-            x = height - 1;
-            y = width * 2 + height - j - 1;
-          } else {
-            x = (width + height) * 2 - j - 1;
-            y = 0;
+          if (type == DISPENSE || type == MIX || type == DETECT) {
+            result.push_back(literal(
+                c[i][j][id][t], schedule.droplet[t][id] == cell));
           }
-          if (model.eval(dispenser[j][i]).bool_value() == Z3_L_TRUE) {
-            out << "dispenser:d" << j << " -> board:f" << x << y << endl;
+          if (regions && (type == MIX || type == DETECT)) {
+            auto &cells = schedule.operation[t][id];
+            bool occupied = find(cells.begin(), cells.end(), cell) != cells.end();
+            result.push_back(
+                literal(c[i][j][graph.nodes.size() + id][t], occupied));
           }
         }
       }
     }
+  }
+  return result;
+}
 
-    // sink
-    for (int j = 0; j < 2 * (width + height); j++) {
-      int x = 0, y = 0;
-      if (j < width) {
-        y = j;
-      } else if (j < width + height) {
-        x = j - width;
-        y = width - 1;
-      } else if (j < width * 2 + height) {
-        x = height - 1;
-        y = width * 2 + height - j - 1;
-      } else {
-        x = (width + height) * 2 - j - 1;
-        y = 0;
-      }
-      if (model.eval(sink[j]).bool_value() == Z3_L_TRUE) {
-        out << "sink:s" << j << " -> board:f" << x << y << endl;
-      }
-    }
-
-    // detect
-    for (int i = 0; i < height; i++) {
-      for (int j = 0; j < width; j++) {
-        for (int id = 0; id < graph.nodes.size(); id++) {
-          for (auto &edge : graph.edges) {
-            if (edge.first == id && graph.nodes[edge.second].type == DETECT) {
-              if (model.eval(detector[i][j][id]).bool_value() == Z3_L_TRUE) {
-                out << "detector:D" << i << j << " -> board:f" << i << j
-                    << endl;
-              }
-              break;
-            }
-          }
+check_result Solver::check() { return check(vector<expr>()); }
+
+check_result Solver::check(const vector<expr> &cube) {
+  while (true) {
+    auto result = check_relaxed(cube);
+    if (result != sat || !lazy) {
+      return result;
+    }
+    // a model of fewer constraints that violates none of the rest is a
+    // model, and an optimal one, of all of them
+    if (refine(extract(solver.get_model())) == 0) {
+      return sat;
+    }
+    refinements++;
+  }
+}
+
+int Solver::get_lazy_groups() { return lazy_groups.size(); }
+
+int Solver::get_refinements() { return refinements; }
+
+check_result Solver::check_relaxed(const vector<expr> &cube) {
+  if (!initial_values.empty()) {
+    // z3 offers no phase hints for optimize, so probe the seed as
+    // assumptions first: if it is a model, its num_points is an upper bound
+    // that prunes the optimization afterwards
+    expr_vector assumptions(solver.ctx());
+    for (auto &value : initial_values) {
+      assumptions.push_back(value);
+    }
+    for (auto &guard : guard_literals) {
+      assumptions.push_back(guard);
+    }
+    if (solver.check(assumptions) == sat) {
+      solver.add(num_points <= solver.get_model().eval(num_points));
+    }
+    initial_values.clear();
+  }
+  if (!guard_literals.empty() || !cube.empty()) {
+    expr_vector assumptions(solver.ctx());
+    for (auto &guard : guard_literals) {
+      assumptions.push_back(guard);
+    }
+    for (auto &literal : cube) {
+      assumptions.push_back(literal);
+    }
+    return solver.check(assumptions);
+  }
+  return solver.check();
+}
+
+vector<vector<Solver::Decision>> Solver::decisions() {
+  vector<vector<Decision>> result;
+  // the ports of every fluid, a port holds at most one fluid
+  for (int f = 0; f < graph.num_dispenser; f++) {
+    vector<Decision> group;
+    for (int p = 0; p < 2 * (width + height); p++) {
+      group.push_back(Decision{dispenser[p][f], p});
+    }
+    result.push_back(group);
+  }
+  // the anchor of every mixer, distinct keys as mixers may share a cell at
+  // different times
+  int key = 2 * (width + height) + width * height;
+  for (auto &node : graph.nodes) {
+    if (node.type == MIX) {
+      vector<Decision> group;
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          group.push_back(Decision{anchor[node.id][x][y], key++});
+        }
+      }
+      result.push_back(group);
+    }
+  }
+  // the detector cell of every detected droplet, a cell holds at most one
+  for (int id = 0; id < graph.nodes.size(); id++) {
+    if (detected[id]) {
+      vector<Decision> group;
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          group.push_back(Decision{detector[x][y][id],
+                                   2 * (width + height) + x * width + y});
         }
       }
+      result.push_back(group);
+    }
+  }
+  return result;
+}
+
+vector<Solver::Guard> Solver::explain(bool minimize) {
+  vector<Guard> result;
+  if (guard_literals.empty()) {
+    return result;
+  }
+
+  // A conflict among the time independent constraints alone rules out every
+  // step count, so look for one of those first. Those are port and detector
+  // counts, which the arithmetic solver refutes easily while CDCL struggles
+  // with them as with any pigeonhole problem.
+  z3::solver probe(solver.ctx());
+  expr_vector assumptions(solver.ctx());
+  map<unsigned, expr> cache;
+  for (auto &constraint : static_constraints) {
+    probe.add(implies(guard_literals[constraint.first],
+                      arithmetic(constraint.second, cache)));
+  }
+  for (int i = 0; i < guards.size(); i++) {
+    if (guards[i].from == 0) {
+      assumptions.push_back(guard_literals[i]);
     }
+  }
+  bool time_independent =
+      !assumptions.empty() && probe.check(assumptions) == unsat;
+  if (!time_independent) {
+    assumptions = expr_vector(solver.ctx());
+    for (auto &guard : guard_literals) {
+      assumptions.push_back(guard);
+    }
+    if (solver.check(assumptions) != unsat) {
+      return result;
+    }
+  }
+  auto check = [&](const expr_vector &subset) {
+    return time_independent ? probe.check(subset) : solver.check(subset);
+  };
 
-    out << "}" << endl;
-    out.close();
-    char cmd_line[128];
-    sprintf(cmd_line, "dot -Tpng -o %s %s", img_name, file_name);
-    system(cmd_line);
+  vector<expr> core;
+  auto unsat_core = time_independent ? probe.unsat_core() : solver.unsat_core();
+  for (unsigned i = 0; i < unsat_core.size(); i++) {
+    core.push_back(unsat_core[i]);
+  }
+  // deletion based: drop every guard whose removal keeps it unsat
+  for (int i = 0; minimize && i < core.size();) {
+    expr_vector rest(solver.ctx());
+    for (int j = 0; j < core.size(); j++) {
+      if (j != i) {
+        rest.push_back(core[j]);
+      }
+    }
+    if (check(rest) == unsat) {
+      core.erase(core.begin() + i);
+    } else {
+      i++;
+    }
   }
-  string cmd_line = "convert -delay 50 -loop 0";
-  for (auto &file : image_names) {
-    cmd_line += " " + file;
+
+  for (auto &literal : core) {
+    result.push_back(guards[guard_index[literal.decl().name().str()]]);
   }
-  cmd_line += " animation.gif";
-  system(cmd_line.c_str());
+  return result;
 }
 
+// atmost/atleast as sums over integers
+expr Solver::arithmetic(const expr &e, map<unsigned, expr> &cache) {
+  if (!e.is_app() || e.num_args() == 0) {
+    return e;
+  }
+  auto it = cache.find(e.id());
+  if (it != cache.end()) {
+    return it->second;
+  }
+  auto kind = e.decl().decl_kind();
+  expr_vector args(e.ctx());
+  for (unsigned i = 0; i < e.num_args(); i++) {
+    args.push_back(arithmetic(e.arg(i), cache));
+  }
+  expr result = e;
+  if (kind == Z3_OP_PB_AT_MOST || kind == Z3_OP_PB_AT_LEAST) {
+    int k = Z3_get_decl_int_parameter(e.ctx(), e.decl(), 0);
+    expr zero = e.ctx().int_val(0);
+    expr one = e.ctx().int_val(1);
+    expr_vector terms(e.ctx());
+    for (unsigned i = 0; i < args.size(); i++) {
+      terms.push_back(ite(args[i], one, zero));
+    }
+    result = kind == Z3_OP_PB_AT_MOST ? sum(terms) <= k : sum(terms) >= k;
+  } else if (e.is_bool()) {
+    result = e.decl()(args);
+  }
+  cache.emplace(e.id(), result);
+  return result;
+}
+
+// With tracking enabled, every constraint is guarded by a literal per
+// family, node and window of track_window steps, so unsat cores can be
+// mapped back to them. t == 0 marks constraints that do not depend on the
+// time, t < 0 ones spanning all steps.
+void Solver::add(const expr &e, const char *family, int node, int t) {
+  if (track_window == 0) {
+    solver.add(e);
+    return;
+  }
+  int from = 0, to = 0;
+  if (t < 0) {
+    from = 1;
+    to = time;
+  } else if (t > 0) {
+    from = (t - 1) / track_window * track_window + 1;
+    to = min(time, from + track_window - 1);
+  }
+  char buffer[512];
+  sprintf(buffer, "guard_%s_i%d_t%d_%d", family, node, from, to);
+  auto it = guard_index.find(buffer);
+  int index = 0;
+  if (it == guard_index.end()) {
+    index = guards.size();
+    guard_index[buffer] = index;
+    guards.push_back(Guard{family, node, from, to});
+    guard_literals.push_back(solver.ctx().bool_const(buffer));
+  } else {
+    index = it->second;
+  }
+  solver.add(implies(guard_literals[index], e));
+  if (t == 0) {
+    static_constraints.emplace_back(index, e);
+  }
+}
+
+void Solver::print(const model &model) { extract(model).print(graph); }
+
 void Solver::add_consistency(context &ctx) {
   // A cell may not be occupied by more than one droplet
   // or mixer i per time step
-  expr_vector consistency1_vec(ctx);
   for (int i = 0; i < height; i++) {
     for (int j = 0; j < width; j++) {
       for (int t = 1; t <= time; t++) {
@@ -374,15 +631,13 @@ void Solver::add_consistency(context &ctx) {
             vec.push_back(c[i][j][graph.nodes.size() + id][t]);
           }
         }
-        consistency1_vec.push_back(atmost(vec, 1));
+        add(atmost(vec, 1), "consistency1", -1, t);
       }
     }
   }
-  solver.add(mk_and(consistency1_vec));
 
   // each droplet i may occur in at most one cell per time
   // step
-  expr_vector consistency2_vec(ctx);
   for (auto &node : graph.nodes) {
     if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
       for (int t = 1; t <= time; t++) {
@@ -392,42 +647,38 @@ void Solver::add_consistency(context &ctx) {
             vec.push_back(c[i][j][node.id][t]);
           }
         }
-        consistency2_vec.push_back(atmost(vec, 1));
+        add(atmost(vec, 1), "consistency2", node.id, t);
       }
     }
   }
-  solver.add(mk_and(consistency2_vec));
 
   // in each position p outside of the grid, there may be at
   // most one dispenser and sink
-  expr_vector consistency3_vec(ctx);
   for (int i = 0; i < 2 * (width + height); i++) {
     expr_vector vec(ctx);
     vec.push_back(sink[i]);
-    for (int j = 0; j < graph.nodes.size(); j++) {
-      if (graph.nodes[j].type == DISPENSE || graph.nodes[j].type == MIX) {
-        vec.push_back(dispenser[i][j]);
-      }
+    for (int j = 0; j < graph.num_dispenser; j++) {
+      vec.push_back(dispenser[i][j]);
     }
-    consistency3_vec.push_back(atmost(vec, 1));
+    add(atmost(vec, 1), "consistency3", -1, 0);
   }
-  solver.add(mk_and(consistency3_vec));
 
   // each cell may be occupied by at most one detector
-  expr_vector consistency5_vec(ctx);
   for (int i = 0; i < height; i++) {
     for (int j = 0; j < width; j++) {
       expr_vector vec(ctx);
       for (int id = 0; id < graph.nodes.size(); id++) {
-        vec.push_back(detector[i][j][id]);
+        if (detected[id]) {
+          vec.push_back(detector[i][j][id]);
+        }
+      }
+      if (vec.size() > 1) {
+        add(atmost(vec, 1), "consistency5", -1, 0);
       }
-      consistency5_vec.push_back(atmost(vec, 1));
     }
   }
-  solver.add(mk_and(consistency5_vec));
 
   // each droplet i should occur in at least one time
-  expr_vector consistency4_vec(ctx);
   for (auto &node : graph.nodes) {
     if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
       expr_vector vec(ctx);
@@ -438,161 +689,243 @@ void Solver::add_consistency(context &ctx) {
           }
         }
       }
-      consistency4_vec.push_back(mk_or(vec));
+      add(mk_or(vec), "consistency4", node.id, -1);
     }
   }
-  solver.add(mk_and(consistency4_vec));
 }
 
 void Solver::add_placement(context &ctx) {
   // For detectors, we ensure that, over all possible (x,y)- cells, for
-  // every type l of fluids a detector is placed
-  expr_vector placement1_vec(ctx);
+  // every droplet l to detect a detector is placed
   for (int id = 0; id < graph.nodes.size(); id++) {
-    if (graph.nodes[id].type == DETECT) {
-      for (auto &edge : graph.edges) {
-        if (edge.second == id) {
-          expr_vector vec(ctx);
-          for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-              vec.push_back(detector[i][j][id]);
-            }
-          }
-          placement1_vec.push_back(mk_or(vec));
+    if (detected[id]) {
+      expr_vector vec(ctx);
+      for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+          vec.push_back(detector[i][j][id]);
         }
       }
+      add(mk_or(vec), "placement1", id, 0);
     }
   }
-  solver.add(mk_and(placement1_vec));
 
   // For dispensers and sinks, we proceed analogously: For
   // every possible outside position p of the grid and every type of fluid
-  // l, we ensure that the desired amount of entities
-  expr_vector placement2_vec(ctx);
-  for (int i = 0; i < graph.nodes.size(); i++) {
-    if (graph.nodes[i].type == DISPENSE || graph.nodes[i].type == MIX) {
-      expr_vector vec(ctx);
-      for (int j = 0; j < 2 * (height + width); j++) {
-        vec.push_back(dispenser[j][i]);
-      }
-      auto n_dispensers = graph.nodes[i].type == DISPENSE ? 1 : 0;
-      placement2_vec.push_back(atmost(vec, n_dispensers));
-      placement2_vec.push_back(atleast(vec, n_dispensers));
+  // l, we ensure that the desired amount of entities. A port of a fluid
+  // serves any number of its dispense nodes, so a fluid has between one
+  // port and one per dispense node.
+  vector<int> dispenses(graph.num_dispenser, 0), first(graph.num_dispenser);
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE && dispenses[node.fluid]++ == 0) {
+      first[node.fluid] = node.id;
+    }
+  }
+  for (int f = 0; f < graph.num_dispenser; f++) {
+    expr_vector vec(ctx);
+    for (int j = 0; j < 2 * (height + width); j++) {
+      vec.push_back(dispenser[j][f]);
     }
+    add(atmost(vec, dispenses[f]), "placement2", first[f], 0);
+    add(atleast(vec, 1), "placement2", first[f], 0);
   }
   expr_vector sink_vec(ctx);
   for (int i = 0; i < 2 * (height + width); i++) {
     sink_vec.push_back(sink[i]);
   }
-  placement2_vec.push_back(atmost(sink_vec, graph.num_output));
-  placement2_vec.push_back(atleast(sink_vec, graph.num_output));
-  solver.add(mk_and(placement2_vec));
+  add(atmost(sink_vec, graph.num_output), "placement2", -1, 0);
+  add(atleast(sink_vec, graph.num_output), "placement2", -1, 0);
+
+  // every mixing operation uses exactly one of the mixers
+  for (int i = 0; i < mixer.size(); i++) {
+    if (!mixer[i].empty()) {
+      expr_vector vec(ctx);
+      for (auto &shape : mixer[i]) {
+        vec.push_back(shape);
+      }
+      add(atmost(vec, 1), "mixer", i, 0);
+      add(atleast(vec, 1), "mixer", i, 0);
+    }
+  }
+}
+
+// steps, rounded up to whole macro-steps
+int Solver::steps(int duration) const {
+  return (duration + stride - 1) / stride;
+}
+
+// The cells a droplet on (x, y) reaches in one step, itself included
+vector<pair<int, int>> Solver::reachable(int x, int y) const {
+  vector<pair<int, int>> result;
+  if (stride == 1) {
+    for (int d = 0; d < 5; d++) {
+      int xx = x + neigh[d][0];
+      int yy = y + neigh[d][1];
+      if (0 <= xx && 0 <= yy && xx < height && yy < width) {
+        result.emplace_back(xx, yy);
+      }
+    }
+    return result;
+  }
+  for (int xx = max(0, x - stride); xx <= min(height - 1, x + stride); xx++) {
+    for (int yy = max(0, y - stride); yy <= min(width - 1, y + stride); yy++) {
+      if (abs(xx - x) + abs(yy - y) <= stride) {
+        result.emplace_back(xx, yy);
+      }
+    }
+  }
+  return result;
+}
+
+// Placements of MIX node i whose output appears at (x, y) at time t, one
+// per mixer and orientation that fits, each implying its inputs, their
+// consumption and the occupied footprint
+vector<expr> Solver::placements(context &ctx, int i, int x, int y, int t) {
+  char buffer[512];
+  vector<expr> result;
+  for (int s = 0; s < mixers.size(); s++) {
+    int mix_time = steps(mixers[s].duration(graph.nodes[i].time));
+    if (t < mix_time + 2) {
+      continue;
+    }
+    auto footprints = mixers[s].footprints();
+    for (int f = 0; f < footprints.size(); f++) {
+      bool inside = true;
+      for (auto &offset : footprints[f]) {
+        int new_x = x + offset.first;
+        int new_y = y + offset.second;
+        inside &= 0 <= new_x && new_x < height && 0 <= new_y && new_y < width;
+      }
+      if (!inside) {
+        continue;
+      }
+
+      sprintf(buffer, "place_i%d_s%d_f%d_x%d_y%d_t%d", i, s, f, x, y, t);
+      expr place = ctx.bool_const(buffer);
+      for (auto &edges : graph.edges) {
+        if (edges.second == i) {
+          // edges.first is an input liquid
+          expr_vector appear_before_mix(ctx);
+          expr_vector disappear_on_mix(ctx);
+          for (int dir = 0; dir < 5; dir++) {
+            int new_x = x + neigh[dir][0];
+            int new_y = y + neigh[dir][1];
+            if (0 <= new_x && new_x < height && 0 <= new_y && new_y < width) {
+              appear_before_mix.push_back(
+                  c[new_x][new_y][edges.first][t - mix_time - 1]);
+            }
+          }
+          for (int ii = 0; ii < height; ii++) {
+            for (int jj = 0; jj < width; jj++) {
+              disappear_on_mix.push_back(c[ii][jj][edges.first][t - mix_time]);
+            }
+          }
+          // the liquid appears in the neighbour before mix
+          add(implies(place, mk_or(appear_before_mix)), "mixing", i, t);
+          // the liquid disappears after mix
+          add(implies(place, !mk_or(disappear_on_mix)), "mixing", i, t);
+        }
+      }
+
+      expr_vector mixing_vec(ctx);
+      for (auto &offset : footprints[f]) {
+        for (int tt = t - mix_time; tt < t; tt++) {
+          mixing_vec.push_back(c[x + offset.first][y + offset.second]
+                                [graph.nodes.size() + i][tt]);
+        }
+      }
+      add(implies(place, mk_and(mixing_vec)), "mixing", i, t);
+      // the mixed liquid appears at the anchor
+      add(implies(place, c[x][y][i][t]), "mixing", i, t);
+      if (!mixer.empty()) {
+        add(implies(place, mixer[i][s]), "mixing", i, t);
+      }
+      placement[i][x][y].push_back(place);
+      result.push_back(place);
+    }
+  }
+  return result;
 }
 
 void Solver::add_movement(context &ctx) {
+  // anchor[i][x][y]: MIX node i has its output at (x, y)
+  char buffer[512];
+  placement.resize(graph.nodes.size());
+  anchor.resize(graph.nodes.size());
+  for (auto &node : graph.nodes) {
+    if (node.type == MIX) {
+      placement[node.id].resize(height, vector<vector<expr>>(width));
+      anchor[node.id].resize(height);
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          sprintf(buffer, "anchor_i%d_x%d_y%d", node.id, x, y);
+          anchor[node.id][x].push_back(ctx.bool_const(buffer));
+        }
+      }
+    }
+  }
+
   for (int i = 0; i < graph.nodes.size(); i++) {
     if (graph.nodes[i].type == DISPENSE || graph.nodes[i].type == MIX ||
         graph.nodes[i].type == DETECT) {
+      // absent[t]: the droplet is nowhere at time t
+      vector<expr> absent(1, ctx.bool_val(true));
+      for (int t = 1; t < time && graph.nodes[i].type == DISPENSE; t++) {
+        expr_vector cells(ctx);
+        for (int x = 0; x < height; x++) {
+          for (int y = 0; y < width; y++) {
+            cells.push_back(c[x][y][i][t]);
+          }
+        }
+        absent.push_back(!mk_or(cells));
+      }
       for (int x = 0; x < height; x++) {
         for (int y = 0; y < width; y++) {
           for (int t = 1; t <= time; t++) {
             expr_vector vec(ctx);
             // from neighbour last time
             if (t > 1) {
-              for (int d = 0; d < 5; d++) {
-                int xx = x + neigh[d][0];
-                int yy = y + neigh[d][1];
-                if (0 <= xx && 0 <= yy && xx < height && yy < width) {
-                  vec.push_back(c[xx][yy][graph.nodes[i].id][t - 1]);
-                }
+              for (auto &cell : reachable(x, y)) {
+                vec.push_back(
+                    c[cell.first][cell.second][graph.nodes[i].id][t - 1]);
               }
             }
 
-            // if it is poured from dispenser
-            if (graph.nodes[i].type == DISPENSE) {
+            // if it is poured from dispenser, not before its release, and
+            // only where it first appears: it may pass the ports of its
+            // fluid later on
+            if (graph.nodes[i].type == DISPENSE &&
+                t >= steps(graph.nodes[i].release)) {
+              int f = graph.nodes[i].fluid;
+              expr_vector ports(ctx);
               if (x == 0) {
-                vec.push_back(dispenser[y][graph.nodes[i].id]);
+                ports.push_back(dispenser[y][f]);
               }
               if (y == 0) {
-                vec.push_back(
-                    dispenser[2 * (width + height) - x - 1][graph.nodes[i].id]);
+                ports.push_back(dispenser[2 * (width + height) - x - 1][f]);
               }
               if (x == height - 1) {
-                vec.push_back(
-                    dispenser[2 * width + height - y - 1][graph.nodes[i].id]);
+                ports.push_back(dispenser[2 * width + height - y - 1][f]);
               }
               if (y == width - 1) {
-                vec.push_back(dispenser[width + x][graph.nodes[i].id]);
+                ports.push_back(dispenser[width + x][f]);
+              }
+              if (ports.size() > 0) {
+                vec.push_back(absent[t - 1] && mk_or(ports));
               }
             }
 
-            // If it is an output from a MIX operation
+            // If it is an output from a MIX operation, started by one of
+            // the placements of the mixer with its anchor here
             if (graph.nodes[i].type == MIX) {
-              if (t >= graph.nodes[i].time + 2) {
-                int direction[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
-                const int mix_width = 2, mix_height = 2;
-                for (int way = 0; way < 4; way++) {
-                  int dir_x = direction[way][0];
-                  int dir_y = direction[way][1];
-
-                  if (0 <= x && x < height &&
-                      0 <= x + (mix_height - 1) * dir_x &&
-                      x + (mix_height - 1) * dir_x < height && 0 <= y &&
-                      y < width && 0 <= y + (mix_width - 1) * dir_y &&
-                      y + (mix_width - 1) * dir_y < width) {
-                    expr_vector mix_vec(ctx);
-                    for (auto &edges : graph.edges) {
-                      if (edges.second == i) {
-                        // edges.first is an input liquid
-                        expr_vector appear_before_mix(ctx);
-                        expr_vector disappear_on_mix(ctx);
-                        for (int dir = 0; dir < 5; dir++) {
-                          int new_x = x + neigh[dir][0];
-                          int new_y = y + neigh[dir][1];
-                          if (0 <= new_x && new_x < height && 0 <= new_y &&
-                              new_y < width) {
-                            appear_before_mix.push_back(
-                                c[new_x][new_y][edges.first]
-                                 [t - graph.nodes[i].time - 1]);
-                          }
-                        }
-                        for (int ii = 0; ii < height; ii++) {
-                          for (int jj = 0; jj < width; jj++) {
-                            disappear_on_mix.push_back(
-                                c[ii][jj][edges.first]
-                                 [t - graph.nodes[i].time]);
-                          }
-                        }
-                        // the liquid appears in the neighbour before mix
-                        mix_vec.push_back(mk_or(appear_before_mix));
-                        // the liquid disappears after mix
-                        mix_vec.push_back(not(mk_or(disappear_on_mix)));
-                      }
-                    }
-
-                    expr_vector mixing_vec(ctx);
-                    for (int ii = 0; ii < mix_width; ii++) {
-                      for (int jj = 0; jj < mix_height; jj++) {
-                        int new_x = x + ii * dir_x;
-                        int new_y = y + jj * dir_y;
-                        for (int tt = t - graph.nodes[i].time; tt < t; tt++) {
-                          mixing_vec.push_back(
-                              c[new_x][new_y]
-                               [graph.nodes.size() + graph.nodes[i].id][tt]);
-                        }
-                      }
-                    }
-                    mix_vec.push_back(mk_and(mixing_vec));
-
-                    vec.push_back(mk_and(mix_vec));
-                  }
-                }
+              for (auto &place : placements(ctx, i, x, y, t)) {
+                vec.push_back(place);
               }
             }
 
             // If the node is a detector node
             if (graph.nodes[i].type == DETECT) {
-              if (t >= graph.nodes[i].time + 2) {
+              int detect_time = steps(graph.nodes[i].time);
+              if (t >= detect_time + 2) {
                 for (auto &edges : graph.edges) {
                   if (edges.second == i) {
                     // only one forward edge
@@ -602,13 +935,13 @@ void Solver::add_movement(context &ctx) {
                     detect_vec.push_back(detector[x][y][edges.first]);
                     // the liquid appears before detecting
                     detect_vec.push_back(
-                        c[x][y][edges.first][t - graph.nodes[i].time - 1]);
+                        c[x][y][edges.first][t - detect_time - 1]);
                     // the liquid disappear on detecting
                     detect_vec.push_back(
-                        not(c[x][y][edges.first][t - graph.nodes[i].time]));
+                        not(c[x][y][edges.first][t - detect_time]));
                     // the new liquid appear after detecting
 
-                    for (int tt = t - graph.nodes[i].time; tt < t; tt++) {
+                    for (int tt = t - detect_time; tt < t; tt++) {
                       detect_vec.push_back(
                           c[x][y][graph.nodes.size() + graph.nodes[i].id][tt]);
                     }
@@ -621,13 +954,13 @@ void Solver::add_movement(context &ctx) {
             }
 
             if (vec.size() > 0) {
-              solver.add(
-                  implies(c[x][y][graph.nodes[i].id][t], atmost(vec, 1)));
-              solver.add(
-                  implies(c[x][y][graph.nodes[i].id][t], atleast(vec, 1)));
+              add(implies(c[x][y][graph.nodes[i].id][t], atmost(vec, 1)),
+                  "movement", i, t);
+              add(implies(c[x][y][graph.nodes[i].id][t], atleast(vec, 1)),
+                  "movement", i, t);
             } else
-              solver.add(
-                  implies(c[x][y][graph.nodes[i].id][t], ctx.bool_val(false)));
+              add(implies(c[x][y][graph.nodes[i].id][t], ctx.bool_val(false)),
+                  "movement", i, t);
           }
         }
       }
@@ -635,6 +968,28 @@ void Solver::add_movement(context &ctx) {
   }
   // solver.add(mk_and(movement));
 
+  // every mixing operation happens exactly once
+  for (int i = 0; i < graph.nodes.size(); i++) {
+    if (graph.nodes[i].type == MIX) {
+      expr_vector vec(ctx);
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          expr_vector here(ctx);
+          for (auto &place : placement[i][x][y]) {
+            vec.push_back(place);
+            here.push_back(place);
+          }
+          solver.add(anchor[i][x][y] == mk_or(here));
+        }
+      }
+      if (vec.size() > 0) {
+        add(atmost(vec, 1), "mixing", i, -1);
+        add(atleast(vec, 1), "mixing", i, -1);
+      } else
+        add(ctx.bool_val(false), "mixing", i, -1);
+    }
+  }
+
   // OUTPUT: liquid should be output to sink
   for (int i = 0; i < graph.nodes.size(); i++) {
     if (graph.nodes[i].type == OUTPUT) {
@@ -647,12 +1002,8 @@ void Solver::add_movement(context &ctx) {
               for (int t = 2; t <= time; t++) {
                 expr_vector vec(ctx);
                 // disappear at time t
-                for (int d = 0; d < 5; d++) {
-                  int xx = x + neigh[d][0];
-                  int yy = y + neigh[d][1];
-                  if (0 <= xx && 0 <= yy && xx < height && yy < width) {
-                    vec.push_back(c[xx][yy][edges.first][t]);
-                  }
+                for (auto &cell : reachable(x, y)) {
+                  vec.push_back(c[cell.first][cell.second][edges.first][t]);
                 }
 
                 auto disappear_at_t = not(mk_or(vec));
@@ -673,9 +1024,9 @@ void Solver::add_movement(context &ctx) {
                   adj_sink.push_back(sink[width + x]);
                 }
                 if (adj_sink.size())
-                  solver.add(implies(disappear, mk_or(adj_sink)));
+                  add(implies(disappear, mk_or(adj_sink)), "output", i, t);
                 else
-                  solver.add(implies(disappear, false));
+                  add(implies(disappear, false), "output", i, t);
               }
             }
           }
@@ -687,7 +1038,7 @@ void Solver::add_movement(context &ctx) {
               disappear_last.push_back(c[x][y][edges.first][time]);
             }
           }
-          solver.add(not(mk_or(disappear_last)));
+          add(not(mk_or(disappear_last)), "output", i, time);
           break;
         }
       }
@@ -696,6 +1047,10 @@ void Solver::add_movement(context &ctx) {
 }
 
 void Solver::add_fluidic_constraint(z3::context &ctx) {
+  if (compact) {
+    add_compact_fluidic_constraint(ctx);
+    return;
+  }
   for (int x = 0; x < height; x++) {
     for (int y = 0; y < width; y++) {
       for (int dx = -1; dx <= 1; dx++) {
@@ -725,7 +1080,7 @@ void Solver::add_fluidic_constraint(z3::context &ctx) {
                             vec.push_back(c[new_x][new_y][j][t+1]);
                           }
                         }
-                        solver.add(implies(c[x][y][i][t] && c[xx][yy][j][t], not(mk_or(vec))));
+                        add(implies(c[x][y][i][t] && c[xx][yy][j][t], not(mk_or(vec))), "static fluidic", i, t);
                       }
 
                       // dynamic fluidic constraint
@@ -740,7 +1095,7 @@ void Solver::add_fluidic_constraint(z3::context &ctx) {
                             vec.push_back(c[new_x][new_y][j][t+2]);
                           }
                         }
-                        solver.add(implies(c[x][y][i][t] && c[xx][yy][j][t+1], not(mk_or(vec))));
+                        add(implies(c[x][y][i][t] && c[xx][yy][j][t+1], not(mk_or(vec))), "dynamic fluidic", i, t);
                       }
                     }
                   }
@@ -752,4 +1107,174 @@ void Solver::add_fluidic_constraint(z3::context &ctx) {
       }
     }
   }
-}
\ No newline at end of file
+}
+// Same constraints with one pair constraint per cell instead of one per
+// adjacent cell, using auxiliary variables for the droplet being anywhere
+// and being near a cell
+void Solver::add_compact_fluidic_constraint(z3::context &ctx) {
+  char buffer[512];
+  vector<int> droplets;
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
+      droplets.push_back(node.id);
+    }
+  }
+
+  // present[i][t]: droplet i is on the grid at time t
+  // near[i][x][y][t]: droplet i is on (x,y) or one of its eight neighbours
+  vector<vector<expr>> present(graph.nodes.size());
+  vector<vector<vector<vector<expr>>>> near(graph.nodes.size());
+  for (int i : droplets) {
+    present[i].resize(time + 1, ctx.bool_val(false));
+    near[i].resize(height);
+    for (int t = 1; t <= time; t++) {
+      expr_vector vec(ctx);
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          vec.push_back(c[x][y][i][t]);
+        }
+      }
+      sprintf(buffer, "present_i%d_t%d", i, t);
+      present[i][t] = ctx.bool_const(buffer);
+      solver.add(present[i][t] == mk_or(vec));
+    }
+    for (int x = 0; x < height; x++) {
+      near[i][x].resize(width);
+      for (int y = 0; y < width; y++) {
+        near[i][x][y].resize(time + 1, ctx.bool_val(false));
+        for (int t = 1; t <= time; t++) {
+          expr_vector vec(ctx);
+          for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+              int xx = x + dx;
+              int yy = y + dy;
+              if (0 <= xx && xx < height && 0 <= yy && yy < width) {
+                vec.push_back(c[xx][yy][i][t]);
+              }
+            }
+          }
+          sprintf(buffer, "near_x%d_y%d_i%d_t%d", x, y, i, t);
+          near[i][x][y][t] = ctx.bool_const(buffer);
+          solver.add(near[i][x][y][t] == mk_or(vec));
+        }
+      }
+    }
+  }
+
+  for (int x = 0; x < height; x++) {
+    for (int y = 0; y < width; y++) {
+      for (int i : droplets) {
+        for (int j : droplets) {
+          if (i != j) {
+            // static fluidic constraint
+            for (int t = 1; t < time; t++) {
+              add(implies(c[x][y][i][t] && near[j][x][y][t],
+                          !present[i][t + 1] && !present[j][t + 1]),
+                  "static fluidic", i, t);
+            }
+            // dynamic fluidic constraint
+            for (int t = 1; t < time - 1; t++) {
+              add(implies(c[x][y][i][t] && near[j][x][y][t + 1],
+                          !present[i][t + 1] && !present[j][t + 2]),
+                  "dynamic fluidic", i, t);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// The fluidic constraints of the droplet pairs that come too close in
+// schedule, each for every cell of the pair at that step, so that the next
+// model cannot just move the pair by one cell
+int Solver::refine(const Schedule &schedule) {
+  context &ctx = solver.ctx();
+  vector<int> droplets;
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
+      droplets.push_back(node.id);
+    }
+  }
+  auto present = [&](int i, int t) {
+    expr_vector vec(ctx);
+    for (int x = 0; x < height; x++) {
+      for (int y = 0; y < width; y++) {
+        vec.push_back(c[x][y][i][t]);
+      }
+    }
+    return mk_or(vec);
+  };
+  auto near = [&](int i, int x, int y, int t) {
+    expr_vector vec(ctx);
+    for (int xx = max(0, x - 1); xx <= min(height - 1, x + 1); xx++) {
+      for (int yy = max(0, y - 1); yy <= min(width - 1, y + 1); yy++) {
+        vec.push_back(c[xx][yy][i][t]);
+      }
+    }
+    return mk_or(vec);
+  };
+  auto on = [&](int i, int t) {
+    return 1 <= t && t <= time && schedule.droplet[t][i].first != -1;
+  };
+  auto close = [&](int i, int ti, int j, int tj) {
+    auto &a = schedule.droplet[ti][i], &b = schedule.droplet[tj][j];
+    return abs(a.first - b.first) <= 1 && abs(a.second - b.second) <= 1;
+  };
+
+  int added = 0;
+  for (int t = 1; t < time; t++) {
+    for (int i : droplets) {
+      if (!on(i, t)) {
+        continue;
+      }
+      for (int j : droplets) {
+        // static, the pair is symmetric
+        if (i < j && on(j, t) && close(i, t, j, t) &&
+            (on(i, t + 1) || on(j, t + 1)) &&
+            lazy_groups.emplace(0, i, j, t).second) {
+          expr gone = !present(i, t + 1) && !present(j, t + 1);
+          for (int x = 0; x < height; x++) {
+            for (int y = 0; y < width; y++) {
+              add(implies(c[x][y][i][t] && near(j, x, y, t), gone),
+                  "static fluidic", i, t);
+            }
+          }
+          added++;
+        }
+        // dynamic, j comes next to where i just was
+        if (i != j && t < time - 1 && on(j, t + 1) && close(i, t, j, t + 1) &&
+            (on(i, t + 1) || on(j, t + 2)) &&
+            lazy_groups.emplace(1, i, j, t).second) {
+          expr gone = !present(i, t + 1) && !present(j, t + 2);
+          for (int x = 0; x < height; x++) {
+            for (int y = 0; y < width; y++) {
+              add(implies(c[x][y][i][t] && near(j, x, y, t + 1), gone),
+                  "dynamic fluidic", i, t);
+            }
+          }
+          added++;
+        }
+      }
+    }
+  }
+  return added;
+}
+
+// Interchangeable sub-DAGs may share their ports, so rather than the order
+// of ports, the second one is not dispensed before the first
+void Solver::add_symmetry(z3::context &ctx) {
+  for (auto &pair : graph.symmetric) {
+    expr_vector before(ctx);
+    for (int t = 1; t <= time; t++) {
+      expr_vector now(ctx);
+      for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+          before.push_back(c[x][y][pair.first][t]);
+          now.push_back(c[x][y][pair.second][t]);
+        }
+      }
+      add(implies(mk_or(now), mk_or(before)), "symmetry", pair.second, t);
+    }
+  }
+}
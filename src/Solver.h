@@ -20,21 +20,102 @@
 #define __SOLVER_H__
 
 #include <z3++.h>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
 #include <vector>
+#include "Device.h"
 #include "Graph.h"
+#include "Schedule.h"
 
 class Solver {
  public:
-  Solver(z3::context& c, const Graph& graph, int width, int height, int time);
+  // constraints guarded for unsat core extraction
+  struct Guard {
+    std::string family;
+    int node;  // -1 when not tied to a node
+    int from;  // window of steps, 0 to 0 when independent of time
+    int to;
+  };
+
+  // a literal to split the search on, literals with the same key exclude
+  // each other
+  struct Decision {
+    z3::expr literal;
+    int key;
+  };
+
+  // size of an encoding, predicted before building it
+  struct Estimate {
+    long long variables;
+    long long constraints;
+    long long literals;  // arguments of all terms, shared terms counted once
+    long long bytes;     // peak memory of building and solving
+  };
+
+  // track_window > 0 guards the constraints for explain(), compact encodes
+  // the fluidic constraints with auxiliary variables in less memory, lazy
+  // adds them only where check() finds a model violating them. stride > 1
+  // makes every step a macro-step of that many: droplets move up to stride
+  // cells and durations and releases are rounded up to macro-steps.
+  Solver(z3::context& c, const Graph& graph, int width, int height, int time,
+         int track_window = 0, const Device& device = Device(),
+         bool compact = false, bool lazy = false, int stride = 1);
+  static Estimate estimate(const Graph& graph, int width, int height,
+                           int time, const Device& device = Device(),
+                           bool compact = false, bool lazy = false);
+  // peak memory of z3 so far in bytes
+  long long get_memory();
   z3::optimize& get_solver();
   int get_num_points();
+  // every constraint as a fact, with arithmetic cardinalities become sums;
+  // adds the fluidic constraints a lazy solver left out
+  z3::expr_vector get_constraints(bool arithmetic = false);
+  z3::expr get_objective();
   void print(const z3::model & model);
+  Schedule extract(const z3::model &model);
+  // seed the next check() with a prior model or a user-supplied schedule
+  void set_initial_values(const Schedule &schedule);
+  // literals assigning every variable to the schedule except where
+  // free(x, y, id, t) holds, called with t = 0 for the static variables
+  // and x = y = -1 for ports, id = -1 for sinks. Without regions the cells
+  // of operations are free everywhere.
+  std::vector<z3::expr> fix(
+      const Schedule &schedule,
+      const std::function<bool(int, int, int, int)> &free = nullptr,
+      bool regions = true);
+  z3::check_result check();
+  // check under the assumption of a partial assignment
+  z3::check_result check(const std::vector<z3::expr> &cube);
+  // fluidic constraints added lazily so far, in groups of a droplet pair and
+  // a step, and the models refused for violating them
+  int get_lazy_groups();
+  int get_refinements();
+  // groups of decisions by impact, every model makes at least one literal of
+  // each group true
+  std::vector<std::vector<Decision>> decisions();
+  // minimized unsat core of the guarded constraints, empty when satisfiable
+  std::vector<Guard> explain(bool minimize = true);
 
  private:
   void add_consistency(z3::context &c);
   void add_placement(z3::context &c);
   void add_movement(z3::context &c);
+  std::vector<z3::expr> placements(z3::context &c, int i, int x, int y, int t);
+  int steps(int duration) const;
+  std::vector<std::pair<int, int>> reachable(int x, int y) const;
   void add_fluidic_constraint(z3::context &c);
+  void add_symmetry(z3::context &c);
+  void add_compact_fluidic_constraint(z3::context &c);
+  z3::check_result check_relaxed(const std::vector<z3::expr> &cube);
+  // adds the fluidic constraints the droplets of schedule violate, returns
+  // the number of new groups
+  int refine(const Schedule &schedule);
+  void add(const z3::expr &e, const char *family, int node, int t);
+  static z3::expr arithmetic(const z3::expr &e,
+                             std::map<unsigned, z3::expr> &cache);
 
 
   z3::optimize solver;
@@ -47,8 +128,30 @@ class Solver {
   int time;
   const Graph &graph;
   std::vector<z3::expr> sink;
+  // dispenser[p][f]: port p dispenses fluid f
   std::vector<std::vector<z3::expr>> dispenser;
+  // detector[x][y][id], only for the droplets consumed by a DETECT node
   std::vector<std::vector<std::vector<z3::expr>>> detector;
+  std::vector<bool> detected;
+  std::vector<Mixer> mixers;
+  // mixer[id][s]: MIX node id uses mixers[s], empty with a single mixer
+  std::vector<std::vector<z3::expr>> mixer;
+  bool compact;
+  bool lazy;
+  // (kind, i, j, t) of the lazy groups, kind 0 static and 1 dynamic
+  std::set<std::tuple<int, int, int, int>> lazy_groups;
+  int refinements;
+  int stride;
+  // placement[id][x][y]: mixing of node id with its output at (x, y)
+  std::vector<std::vector<std::vector<std::vector<z3::expr>>>> placement;
+  std::vector<std::vector<std::vector<z3::expr>>> anchor;
+  // literals of the warm start assignment
+  std::vector<z3::expr> initial_values;
+  int track_window;
+  std::map<std::string, int> guard_index;
+  std::vector<Guard> guards;
+  std::vector<z3::expr> guard_literals;
+  std::vector<std::pair<int, z3::expr>> static_constraints;
 };
 
 #endif
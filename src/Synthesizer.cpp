@@ -0,0 +1,322 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Synthesizer.h"
+#include <z3++.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include "Coordinator.h"
+#include "Heuristic.h"
+#include "LocalSearch.h"
+#include "Portfolio.h"
+#include "Verifier.h"
+
+using namespace z3;
+using namespace std;
+using namespace std::chrono;
+
+Synthesizer::Synthesizer(const Graph &graph)
+    : Synthesizer(graph, Options()) {}
+
+Synthesizer::Synthesizer(const Graph &graph, const Options &options)
+    : input(graph), reduction(graph), options(options), deadline(0),
+      cancelled(false) {}
+
+void Synthesizer::set_callback(const callback_type &callback) {
+  this->callback = callback;
+}
+
+const Graph &Synthesizer::get_graph() const {
+  return options.reduce ? reduction.get_graph() : input;
+}
+
+const Reduction &Synthesizer::get_reduction() const { return reduction; }
+
+void Synthesizer::cancel() { cancelled = true; }
+
+bool Synthesizer::stopped() const {
+  return cancelled ||
+         (deadline && steady_clock::now() - start >= milliseconds(deadline));
+}
+
+// calls poll every 10 ms on a thread of its own until destroyed
+class Watchdog {
+ public:
+  explicit Watchdog(const std::function<void()> &poll)
+      : done(false), worker([this, poll]() {
+          while (!done) {
+            this_thread::sleep_for(milliseconds(10));
+            poll();
+          }
+        }) {}
+  ~Watchdog() {
+    done = true;
+    worker.join();
+  }
+
+ private:
+  atomic<bool> done;
+  thread worker;
+};
+
+void Synthesizer::report(Phase phase, int step, Answer answer, int points) {
+  Progress progress;
+  progress.phase = phase;
+  progress.step = step;
+  progress.answer = answer;
+  progress.points = points;
+  report(progress);
+}
+
+void Synthesizer::report(Progress progress) {
+  if (callback) {
+    progress.elapsed =
+        duration_cast<milliseconds>(steady_clock::now() - start).count();
+    callback(progress);
+  }
+}
+
+Synthesizer::Result Synthesizer::run(unsigned deadline) {
+  start = steady_clock::now();
+  this->deadline = deadline;
+  cancelled = false;
+  return synthesize();
+}
+
+Synthesizer::Result Synthesizer::synthesize() {
+  const Graph &graph = get_graph();
+  Schedule hint = options.warm_start;
+  if (hint.time && !hint.fits(graph, options.width, options.height)) {
+    hint = Schedule();
+  }
+  if (options.reduce) {
+    reduction.canonicalize(hint);
+  }
+
+  report(HEURISTIC, 0, RUNNING);
+  Schedule upper;
+  Heuristic heuristic(graph, options.width, options.height, options.device);
+  bool has_upper = heuristic.run(upper);
+  if (has_upper) {
+    if (options.reduce) {
+      reduction.canonicalize(upper);
+    }
+    report(HEURISTIC, upper.time, SAT, upper.num_points());
+  } else {
+    report(HEURISTIC, 0, UNKNOWN);
+  }
+
+  Result result{NOT_FOUND, 0, Schedule()};
+  for (int i = 1; !stopped(); i++) {
+    if (!has_upper && options.max_steps && i > options.max_steps) {
+      break;
+    }
+    const Schedule *seed = hint.time ? &hint : nullptr;
+    if (has_upper && i == upper.time && (!seed || seed->time > i)) {
+      seed = &upper;
+    }
+    Schedule schedule;
+    bool give_up = false;
+    Answer answer = solve(i, seed, schedule, give_up);
+    if (answer == SAT) {
+      result = Result{OPTIMAL, i, schedule};
+      break;
+    }
+    if (give_up || answer == UNKNOWN || (has_upper && i >= upper.time)) {
+      break;
+    }
+  }
+  if (!result.makespan) {
+    if (has_upper) {
+      result = Result{FEASIBLE, upper.time, upper};
+    }
+    if (stopped()) {
+      result.status = cancelled ? CANCELLED : TIMEOUT;
+    }
+  }
+  report(FINISHED, result.makespan, result.makespan ? SAT : UNKNOWN,
+         result.makespan ? result.schedule.num_points() : 0);
+  return result;
+}
+
+Synthesizer::Answer Synthesizer::solve(int steps, const Schedule *hint,
+                                       Schedule &schedule, bool &give_up) {
+  const Graph &graph = get_graph();
+  int width = options.width, height = options.height;
+  Progress progress;
+  progress.phase = SEARCH;
+  progress.step = steps;
+  progress.answer = RUNNING;
+  progress.points = 0;
+  // the portfolio, local search and plain solver solve copies that are not
+  // refined
+  bool lazy = options.lazy && options.portfolio <= 1 && !options.lns &&
+              options.minimize;
+  // fall back to cheaper encodings before running out of memory
+  progress.size = Solver::estimate(graph, width, height, steps,
+                                   options.device, false, lazy);
+  long long budget = (long long)options.memory << 20;
+  if (budget && progress.size.bytes > budget) {
+    progress.compact = true;
+    progress.size = Solver::estimate(graph, width, height, steps,
+                                     options.device, true, lazy);
+  }
+  progress.over_budget = budget && progress.size.bytes > budget;
+  report(progress);
+  if (progress.over_budget) {
+    progress.answer = UNKNOWN;
+    report(progress);
+    return UNKNOWN;
+  }
+
+  context c;
+  check_result result = unknown;
+  atomic<bool> halt(false);       // stopped or out of memory
+  atomic<bool> exhausted(false);  // out of memory
+  auto before = steady_clock::now();
+  try {
+    Solver solver(c, graph, width, height, steps, options.explain,
+                  options.device, progress.compact, lazy);
+    if (hint && hint->time <= steps) {
+      // a schedule that fits in fewer steps still fits when delayed
+      solver.set_initial_values(hint->shift(steps - hint->time));
+    }
+    auto &ans = solver.get_solver();
+    Profile::apply(ans, options.params);
+    if (options.timeout) {
+      params p(c);
+      p.set("timeout", options.timeout);
+      ans.set(p);
+    }
+    // workers are forked while this is the only thread
+    unique_ptr<Coordinator> coordinator;
+    if (options.workers > 1) {
+      coordinator.reset(new Coordinator(solver, options.workers));
+      coordinator->start(options.memory);
+      progress.cubes = coordinator->get_num_cubes();
+    }
+    // an interrupt only stops a running check, so the watchdog repeats it
+    // until the search has noticed
+    Watchdog watchdog([&]() {
+      bool over =
+          budget && (long long)Z3_get_estimated_alloc_size() > budget;
+      if (over || stopped()) {
+        exhausted = exhausted || over;
+        halt = true;
+        c.interrupt();
+      }
+    });
+    if (stopped()) {
+      result = unknown;
+    } else if (coordinator) {
+      result = coordinator->check(schedule, &halt);
+    } else if (options.portfolio > 1) {
+      Portfolio portfolio(solver);
+      result = portfolio.check(Portfolio::configs(options.portfolio),
+                               schedule, options.timeout, &halt);
+      if (result != unknown) {
+        progress.winner = portfolio.get_winner();
+      }
+    } else if (options.lns) {
+      // any schedule will do, so a hint that fits needs no solving
+      Verifier verifier(graph, options.device);
+      if (hint && hint->time <= steps &&
+          verifier.verify(hint->shift(steps - hint->time))) {
+        schedule = hint->shift(steps - hint->time);
+        result = sat;
+      } else {
+        Portfolio portfolio(solver);
+        result = portfolio.check({Portfolio::configs(2)[1]}, schedule,
+                                 options.timeout, &halt);
+      }
+    } else if (!options.minimize) {
+      Portfolio portfolio(solver);
+      Portfolio::Config plain{"solver", false, false, options.params};
+      result = portfolio.check({plain}, schedule, options.timeout, &halt);
+    } else {
+      result = solver.check();
+      if (result == sat) {
+        schedule = solver.extract(ans.get_model());
+      }
+    }
+    if (result == sat && options.lns && !halt) {
+      report(LOCAL_SEARCH, steps, RUNNING, schedule.num_points());
+      unsigned limit = options.lns;
+      if (deadline) {
+        long long left =
+            deadline -
+            duration_cast<milliseconds>(steady_clock::now() - start).count();
+        limit = min<long long>(limit, max(0ll, left));
+      }
+      LocalSearch search(graph, options.device, progress.compact);
+      search.run(schedule, limit, options.lns_threads, 0, &halt);
+      Progress improved;
+      improved.phase = LOCAL_SEARCH;
+      improved.step = steps;
+      improved.answer = SAT;
+      improved.points = schedule.num_points();
+      improved.rounds = search.get_rounds();
+      report(improved);
+    }
+    progress.used =
+        duration_cast<milliseconds>(steady_clock::now() - before).count();
+    progress.memory = solver.get_memory();
+    if (lazy && options.workers <= 1) {
+      progress.lazy_groups = solver.get_lazy_groups();
+      progress.refinements = solver.get_refinements();
+    }
+    if (result == unsat && options.explain) {
+      progress.core = solver.explain();
+      give_up = !progress.core.empty();
+      for (auto &guard : progress.core) {
+        give_up = give_up && guard.from == 0;
+      }
+    }
+    if (result == sat && !options.smt2.empty()) {
+      ofstream out(options.smt2);
+      out << ans;
+    }
+  } catch (z3::exception e) {
+    // out of memory or interrupted
+    progress.error = e.msg();
+    progress.used =
+        duration_cast<milliseconds>(steady_clock::now() - before).count();
+    result = unknown;
+  }
+  if (exhausted && result != sat) {
+    progress.error = "Exceeded the memory budget of " +
+                     to_string(options.memory) + "MB";
+    result = unknown;
+  }
+
+  if (result == sat) {
+    Verifier verifier(graph, options.device);
+    if (!verifier.verify(schedule)) {
+      throw logic_error("Schedule violates " + verifier.get_violation());
+    }
+    progress.answer = SAT;
+    progress.points = schedule.num_points();
+  } else {
+    progress.answer = result == unsat ? UNSAT : UNKNOWN;
+  }
+  report(progress);
+  return progress.answer;
+}
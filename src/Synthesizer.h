@@ -0,0 +1,141 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __SYNTHESIZER_H__
+#define __SYNTHESIZER_H__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Device.h"
+#include "Graph.h"
+#include "Profile.h"
+#include "Reduction.h"
+#include "Schedule.h"
+#include "Solver.h"
+
+// The whole synthesis of one graph as a library call: reduction, the
+// heuristic upper bound and the search for the least number of steps, as
+// done by OPSDMFB, which only prints the progress and saves the result. run()
+// blocks; cancel() may be called from any thread while it runs.
+class Synthesizer {
+ public:
+  struct Options {
+    int width = 5;
+    int height = 5;
+    Device device;
+    unsigned timeout = 0;  // ms per number of steps, 0 for none
+    // MB an encoding may take to build and solve, 0 for any; z3 is
+    // interrupted beyond it
+    unsigned memory = 0;
+    int workers = 1;       // processes for cube and conquer
+    int portfolio = 1;     // threads racing different configurations
+    unsigned lns = 0;      // ms of local search instead of optimization
+    int lns_threads = 1;
+    bool reduce = true;
+    bool lazy = false;  // fluidic constraints only where models violate them
+    // steps per window of the unsat core of a step, 0 for none; the search
+    // stops once only time independent constraints conflict
+    int explain = 0;
+    // steps to try at most without a heuristic schedule, 0 for no limit
+    int max_steps = 0;
+    Schedule warm_start;  // time 0 for none, ignored if it does not fit
+    // num_points of each step, otherwise any schedule of the least steps
+    // will do and a plain solver finds it
+    bool minimize = true;
+    // applied as by Profile, optimize leaves out Profile::unsupported ones
+    Profile::params_type params;
+    // file for the constraints of the satisfiable step, empty for none
+    std::string smt2;
+  };
+
+  enum Phase { HEURISTIC, SEARCH, LOCAL_SEARCH, FINISHED };
+  enum Answer { RUNNING, SAT, UNSAT, UNKNOWN };
+
+  struct Progress {
+    Phase phase;
+    int step;       // steps tried in SEARCH, otherwise of the schedule
+    Answer answer;  // RUNNING when the phase or step starts
+    int points;     // num_points of the schedule found, 0 for none
+    long long elapsed;  // ms since run() started
+
+    // of a SEARCH step, the encoding as estimated before building it
+    Solver::Estimate size = {0, 0, 0, 0};
+    bool compact = false;  // the cheaper fluidic encoding within the memory
+    bool over_budget = false;  // not built, as not even that fits
+    // of a SEARCH step once answered
+    long long used = 0;    // ms of building and solving
+    long long memory = 0;  // bytes z3 took
+    int cubes = 0;         // split among options.workers, 0 for none
+    std::string winner;    // configuration of the portfolio that answered
+    int lazy_groups = -1;  // of fluidic constraints added, -1 unless lazy
+    int refinements = 0;
+    std::vector<Solver::Guard> core;  // of an UNSAT step with explain
+    std::string error;  // of z3 that made the step UNKNOWN, if any
+    // of LOCAL_SEARCH once answered
+    int rounds = 0;
+  };
+  typedef std::function<void(const Progress &)> callback_type;
+
+  enum Status {
+    OPTIMAL,     // no schedule with fewer steps exists
+    FEASIBLE,    // the heuristic schedule, the search gave up
+    NOT_FOUND,   // no schedule within max_steps or the timeouts
+    TIMEOUT,     // deadline passed, schedule is the best known if any
+    CANCELLED    // as TIMEOUT, by cancel()
+  };
+
+  struct Result {
+    Status status;
+    int makespan;  // 0 without a schedule
+    Schedule schedule;
+  };
+
+  explicit Synthesizer(const Graph &graph);
+  Synthesizer(const Graph &graph, const Options &options);
+  // called on the thread of run()
+  void set_callback(const callback_type &callback);
+  // deadline in ms for the whole call, 0 for none
+  Result run(unsigned deadline = 0);
+  // thread safe, interrupts z3 within a few ms
+  void cancel();
+  // the graph schedules refer to, without pruned nodes
+  const Graph &get_graph() const;
+  const Reduction &get_reduction() const;
+
+ private:
+  Result synthesize();
+  Answer solve(int steps, const Schedule *hint, Schedule &schedule,
+               bool &give_up);
+  void report(Phase phase, int step, Answer answer, int points = 0);
+  void report(Progress progress);
+  // cancelled or past the deadline
+  bool stopped() const;
+
+  Graph input;
+  Reduction reduction;
+  Options options;
+  callback_type callback;
+  std::chrono::steady_clock::time_point start;
+  unsigned deadline;
+  std::atomic<bool> cancelled;
+};
+
+#endif
@@ -0,0 +1,397 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Verifier.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+Verifier::Verifier(const Graph &graph, const Device &device)
+    : graph(graph), mixers(device.mixers), schedule(nullptr) {
+  for (auto &node : graph.nodes) {
+    if (node.type == DISPENSE || node.type == MIX || node.type == DETECT) {
+      droplets.push_back(node.id);
+    }
+  }
+}
+
+void Verifier::trim(Schedule &schedule, int from) {
+  for (int t = from; t <= schedule.time; t++) {
+    for (int id = 0; id < schedule.num_nodes; id++) {
+      auto &cells = schedule.operation[t][id];
+      for (int k = (int)cells.size() - 1; k >= 0; k--) {
+        auto cell = cells[k];
+        cells.erase(cells.begin() + k);
+        if (!verify(schedule)) {
+          cells.insert(cells.begin() + k, cell);
+        }
+      }
+    }
+  }
+}
+
+bool Verifier::verify(const Schedule &schedule) {
+  this->schedule = &schedule;
+  violation.clear();
+  if (schedule.num_nodes != graph.nodes.size() || schedule.width <= 0 ||
+      schedule.height <= 0 || schedule.width > 64) {
+    violation = "schedule does not fit the assay";
+    return false;
+  }
+  return check_resources() && check_consistency() && check_movement() &&
+         check_output() && check_fluidic();
+}
+
+const string &Verifier::get_violation() const { return violation; }
+
+bool Verifier::fail(const char *family, int node, int t) {
+  char buffer[256];
+  sprintf(buffer, "%s of node %d at step %d", family, node, t);
+  violation = buffer;
+  return false;
+}
+
+bool Verifier::present(int id, int t) const {
+  return 1 <= t && t <= schedule->time && schedule->droplet[t][id].first != -1;
+}
+
+// droplet id on (x, y) or one of its eight neighbours at t
+bool Verifier::near(int id, int t, int x, int y) const {
+  if (!present(id, t)) {
+    return false;
+  }
+  auto &cell = schedule->droplet[t][id];
+  return abs(cell.first - x) <= 1 && abs(cell.second - y) <= 1;
+}
+
+bool Verifier::check_resources() {
+  auto &s = *schedule;
+  int ports = 2 * (s.width + s.height);
+  vector<int> owner(ports, -1);
+  int sinks = 0;
+  for (int p = 0; p < ports; p++) {
+    if (s.sink[p]) {
+      owner[p] = -2;
+      sinks++;
+    }
+  }
+  if (sinks != graph.num_output) {
+    return fail("placement2", -1, 0);
+  }
+  // a port dispenses one fluid, for any number of its dispense nodes
+  for (int id = 0; id < graph.nodes.size(); id++) {
+    int p = s.dispenser[id], f = graph.nodes[id].fluid;
+    if (graph.nodes[id].type != DISPENSE) {
+      if (p != -1) {
+        return fail("placement2", id, 0);
+      }
+    } else if (p < 0 || p >= ports) {
+      return fail("placement2", id, 0);
+    } else if (owner[p] != -1 && owner[p] != f) {
+      return fail("consistency3", id, 0);
+    } else {
+      owner[p] = f;
+    }
+  }
+
+  // Solver only places detectors for the droplets to detect
+  vector<bool> detected(graph.nodes.size(), false);
+  for (auto &edge : graph.edges) {
+    if (graph.nodes[edge.second].type == DETECT) {
+      detected[edge.first] = true;
+    }
+  }
+  board_type used(s.height, 0);
+  for (int id = 0; id < graph.nodes.size(); id++) {
+    int x = s.detector[id].first, y = s.detector[id].second;
+    if (x == -1 || !detected[id]) {
+      continue;
+    }
+    if (x < 0 || x >= s.height || y < 0 || y >= s.width ||
+        (used[x] >> y & 1)) {
+      return fail("consistency5", id, 0);
+    }
+    used[x] |= 1ull << y;
+  }
+  for (int id = 0; id < graph.nodes.size(); id++) {
+    if (detected[id] && s.detector[id].first == -1) {
+      return fail("placement1", id, 0);
+    }
+  }
+  return true;
+}
+
+bool Verifier::check_consistency() {
+  auto &s = *schedule;
+  auto inside = [&](const Schedule::cell_type &cell) {
+    return 0 <= cell.first && cell.first < s.height && 0 <= cell.second &&
+           cell.second < s.width;
+  };
+  board_type once(s.height), twice(s.height), region(s.height);
+  for (int t = 1; t <= s.time; t++) {
+    fill(once.begin(), once.end(), 0);
+    fill(twice.begin(), twice.end(), 0);
+    auto count = [&](int x, uint64_t bits) {
+      twice[x] |= once[x] & bits;
+      once[x] |= bits;
+    };
+    for (int id : droplets) {
+      auto &cell = s.droplet[t][id];
+      if (cell.first == -1) {
+        continue;
+      }
+      if (!inside(cell)) {
+        return fail("consistency2", id, t);
+      }
+      // detected droplets are left out, as in Solver
+      if (graph.nodes[id].type != DETECT) {
+        count(cell.first, 1ull << cell.second);
+      }
+    }
+    for (int id = 0; id < graph.nodes.size(); id++) {
+      if (s.operation[t][id].empty()) {
+        continue;
+      }
+      fill(region.begin(), region.end(), 0);
+      for (auto &cell : s.operation[t][id]) {
+        if (!inside(cell)) {
+          return fail("consistency1", id, t);
+        }
+        region[cell.first] |= 1ull << cell.second;
+      }
+      for (int x = 0; x < s.height; x++) {
+        count(x, region[x]);
+      }
+    }
+    for (int x = 0; x < s.height; x++) {
+      if (twice[x]) {
+        return fail("consistency1", -1, t);
+      }
+    }
+  }
+
+  for (int id : droplets) {
+    bool seen = false;
+    for (int t = 1; t <= s.time && !seen; t++) {
+      seen = present(id, t);
+    }
+    if (!seen) {
+      return fail("consistency4", id, -1);
+    }
+  }
+  return true;
+}
+
+// Every droplet on the grid comes from exactly one source: a neighbouring
+// cell, its dispenser, its mixing or its detection
+bool Verifier::check_movement() {
+  auto &s = *schedule;
+  auto operating = [&](int t, int id, int x, int y) {
+    auto &cells = s.operation[t][id];
+    return find(cells.begin(), cells.end(), Schedule::cell_type(x, y)) !=
+           cells.end();
+  };
+  for (int id : droplets) {
+    auto &node = graph.nodes[id];
+    int input = -1;
+    for (auto &edge : graph.edges) {
+      if (edge.second == id) {
+        input = edge.first;
+        break;
+      }
+    }
+    int placed = 0;
+    for (int t = 1; t <= s.time; t++) {
+      if (!present(id, t)) {
+        continue;
+      }
+      int x = s.droplet[t][id].first, y = s.droplet[t][id].second;
+      int sources = 0;
+      if (present(id, t - 1)) {
+        auto &from = s.droplet[t - 1][id];
+        sources += abs(from.first - x) + abs(from.second - y) <= 1;
+      }
+      // a port dispenses the droplet only where it first appears
+      if (node.type == DISPENSE && t >= node.release && !present(id, t - 1)) {
+        sources += s.port_cell(s.dispenser[id]) == Schedule::cell_type(x, y);
+      } else if (node.type == MIX && sources == 0) {
+        if (check_mixing(id, x, y, t)) {
+          sources++;
+          placed++;
+        }
+      } else if (node.type == DETECT && input != -1 && t >= node.time + 2) {
+        int start = t - node.time;
+        bool detected = s.detector[input] == Schedule::cell_type(x, y) &&
+                        s.droplet[start - 1][input] == s.droplet[t][id] &&
+                        s.droplet[start][input] != s.droplet[t][id];
+        for (int tt = start; tt < t && detected; tt++) {
+          detected = operating(tt, id, x, y);
+        }
+        sources += detected;
+      }
+      if (sources != 1) {
+        return fail("movement", id, t);
+      }
+    }
+    if (node.type == MIX && placed != 1) {
+      return fail("mixing", id, -1);
+    }
+  }
+  return true;
+}
+
+// some mixer and orientation explains the output of MIX node id
+bool Verifier::check_mixing(int id, int x, int y, int t) {
+  auto &s = *schedule;
+  for (auto &mixer : mixers) {
+    int mix_time = mixer.duration(graph.nodes[id].time);
+    if (t < mix_time + 2) {
+      continue;
+    }
+    bool inputs = true;
+    for (auto &edge : graph.edges) {
+      if (edge.second == id) {
+        auto &before = s.droplet[t - mix_time - 1][edge.first];
+        inputs &= before.first != -1 &&
+                  abs(before.first - x) + abs(before.second - y) <= 1 &&
+                  !present(edge.first, t - mix_time);
+      }
+    }
+    if (!inputs) {
+      continue;
+    }
+    for (auto &footprint : mixer.footprints()) {
+      bool covered = true;
+      for (int tt = t - mix_time; tt < t && covered; tt++) {
+        auto &cells = s.operation[tt][id];
+        for (auto &offset : footprint) {
+          auto cell = Schedule::cell_type(x + offset.first, y + offset.second);
+          covered &= find(cells.begin(), cells.end(), cell) != cells.end();
+        }
+      }
+      if (covered) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// droplets leave the grid only next to a sink, and are gone at the end
+bool Verifier::check_output() {
+  auto &s = *schedule;
+  int ports = 2 * (s.width + s.height);
+  for (int id = 0; id < graph.nodes.size(); id++) {
+    if (graph.nodes[id].type != OUTPUT) {
+      continue;
+    }
+    for (auto &edge : graph.edges) {
+      if (edge.second != id) {
+        continue;
+      }
+      int input = edge.first;
+      for (int t = 2; t <= s.time; t++) {
+        if (!present(input, t - 1)) {
+          continue;
+        }
+        auto &from = s.droplet[t - 1][input];
+        if (present(input, t)) {
+          auto &to = s.droplet[t][input];
+          if (abs(from.first - to.first) + abs(from.second - to.second) <= 1) {
+            continue;
+          }
+        }
+        bool sink = false;
+        for (int p = 0; p < ports; p++) {
+          sink |= s.sink[p] && s.port_cell(p) == from;
+        }
+        if (!sink) {
+          return fail("output", id, t);
+        }
+      }
+      if (present(input, s.time)) {
+        return fail("output", id, s.time);
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+void Verifier::count_near(int t, board_type &once, board_type &twice) const {
+  int height = schedule->height, width = schedule->width;
+  uint64_t full = width == 64 ? ~0ull : (1ull << width) - 1;
+  fill(once.begin(), once.end(), 0);
+  fill(twice.begin(), twice.end(), 0);
+  for (int id : droplets) {
+    if (!present(id, t)) {
+      continue;
+    }
+    int x = schedule->droplet[t][id].first;
+    uint64_t bit = 1ull << schedule->droplet[t][id].second;
+    uint64_t row = (bit | bit << 1 | bit >> 1) & full;
+    for (int xx = max(0, x - 1); xx <= min(height - 1, x + 1); xx++) {
+      twice[xx] |= once[xx] & row;
+      once[xx] |= row;
+    }
+  }
+}
+
+// Two droplets within one cell of each other must both be gone the next
+// step (static), and a droplet next to where another one just was must be
+// gone the step after (dynamic)
+bool Verifier::check_fluidic() {
+  auto &s = *schedule;
+  board_type once(s.height), twice(s.height);
+  board_type next_once(s.height), next_twice(s.height);
+  // whether a droplet other than id is near (x, y) at t, given the counts
+  auto others = [&](const board_type &once, const board_type &twice, int id,
+                    int t, int x, int y) {
+    uint64_t bit = 1ull << y;
+    return (near(id, t, x, y) ? twice[x] : once[x]) & bit;
+  };
+  if (s.time >= 1) {
+    count_near(1, next_once, next_twice);
+  }
+  for (int t = 1; t < s.time; t++) {
+    once.swap(next_once);
+    twice.swap(next_twice);
+    count_near(t + 1, next_once, next_twice);
+    for (int id : droplets) {
+      if (present(id, t)) {
+        int x = s.droplet[t][id].first, y = s.droplet[t][id].second;
+        if (others(once, twice, id, t, x, y) && present(id, t + 1)) {
+          return fail("static fluidic", id, t);
+        }
+        if (t + 1 < s.time && others(next_once, next_twice, id, t + 1, x, y) &&
+            present(id, t + 1)) {
+          return fail("dynamic fluidic", id, t);
+        }
+      }
+      if (t + 1 < s.time && present(id, t + 1)) {
+        int x = s.droplet[t + 1][id].first, y = s.droplet[t + 1][id].second;
+        if (others(once, twice, id, t, x, y) && present(id, t + 2)) {
+          return fail("dynamic fluidic", id, t);
+        }
+      }
+    }
+  }
+  return true;
+}
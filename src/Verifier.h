@@ -0,0 +1,64 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __VERIFIER_H__
+#define __VERIFIER_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Device.h"
+#include "Graph.h"
+#include "Schedule.h"
+
+// Replays a schedule on the grid and checks it against the same rules as
+// the constraints of Solver, without z3. Occupancy and neighbourhoods are
+// kept in bitboards of one word per row, so grids are at most 64 cells wide.
+class Verifier {
+ public:
+  Verifier(const Graph &graph, const Device &device = Device());
+  // returns false and describes the first violation found
+  bool verify(const Schedule &schedule);
+  const std::string &get_violation() const;
+  // drops the cells of operations from step from on that a valid schedule
+  // stays valid without, as solvers without the objective leave them
+  void trim(Schedule &schedule, int from = 1);
+
+ private:
+  typedef std::vector<uint64_t> board_type;
+
+  bool check_resources();
+  bool check_consistency();
+  bool check_movement();
+  bool check_mixing(int id, int x, int y, int t);
+  bool check_output();
+  bool check_fluidic();
+  // cells within one step of each droplet, counted up to two
+  void count_near(int t, board_type &once, board_type &twice) const;
+  bool present(int id, int t) const;
+  bool near(int id, int t, int x, int y) const;
+  bool fail(const char *family, int node, int t);
+
+  const Graph &graph;
+  std::vector<Mixer> mixers;
+  const Schedule *schedule;
+  std::vector<int> droplets;
+  std::string violation;
+};
+
+#endif
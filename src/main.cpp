@@ -16,59 +16,390 @@
 // along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
-#include <fstream>
+#include <map>
+#include <string.h>
+#include <thread>
 #include <z3++.h>
 
 using namespace std::chrono;
 
+#include "Actuation.h"
+#include "Coarse.h"
+#include "Device.h"
 #include "Graph.h"
+#include "Online.h"
+#include "Profile.h"
+#include "Schedule.h"
 #include "Solver.h"
+#include "Synthesizer.h"
+#include "Verifier.h"
 
 using namespace z3;
 using namespace std;
 
-bool try_steps(const Graph &graph, int width, int height, int n) {
-  try {
-    cout << "Trying step " << n << endl;
-    context c;
-    auto before = high_resolution_clock::now();
-    Solver solver(c, graph, width, height, n);
-    auto& ans = solver.get_solver();
-    auto result = ans.check();
-    auto after = high_resolution_clock::now();
-    cout << "Used " << duration_cast<milliseconds>(after - before).count()
-         << "ms" << endl;
-    if (result != sat) {
-      cout << "Unsatisfiable" << endl;
-    } else {
-      cout << "Satisfiable" << endl;
-      cout << "Printing sat constraints to sat.smt2" << endl;
-      ofstream out("sat.smt2");
-      out << ans;
-      auto model = ans.get_model();
-      cout << "Printing to model:" << endl;
-      solver.print(model);
-      return true;
+void export_actuation(const Graph &graph, const Schedule &schedule,
+                      const char *file, bool min_pins) {
+  if (!file) {
+    return;
+  }
+  Actuation actuation(graph, schedule);
+  if (min_pins) {
+    actuation.minimize_pins();
+  }
+  cout << "Printing " << actuation.get_time() << " frames of "
+       << actuation.get_pins() << " pins for " << actuation.get_electrodes()
+       << " electrodes to " << file << endl;
+  actuation.save(file);
+}
+
+void print_core(const vector<Solver::Guard> &core) {
+  bool time_independent = !core.empty();
+  cout << "Unsat core:" << endl;
+  for (auto &guard : core) {
+    cout << "  " << guard.family;
+    if (guard.node != -1) {
+      cout << " node " << guard.node;
+    }
+    if (guard.from != 0) {
+      cout << " steps " << guard.from << "-" << guard.to;
+      time_independent = false;
+    }
+    cout << endl;
+  }
+  if (time_independent) {
+    cout << "Only time independent constraints conflict" << endl;
+  }
+}
+
+// savings of the reduction at the heuristic makespan, or at one step
+void print_reduction(const Graph &input, const Synthesizer &synthesizer,
+                     const Synthesizer::Options &options, int steps) {
+  auto &reduction = synthesizer.get_reduction();
+  int width = options.width, height = options.height;
+  auto before =
+      Solver::estimate(input, width, height, steps, options.device);
+  auto after = Solver::estimate(synthesizer.get_graph(), width, height,
+                                steps, options.device);
+  cout << "Reduction removed " << reduction.get_removed()
+       << " nodes and ordered " << reduction.get_symmetric()
+       << " interchangeable sub-DAGs";
+  // the order of the sub-DAGs adds constraints of its own
+  long long variables = before.variables - after.variables;
+  long long constraints = before.constraints - after.constraints;
+  if (variables > 0 || constraints > 0) {
+    cout << ", saving";
+    if (variables > 0) {
+      cout << " " << variables << " variables";
+    }
+    if (variables > 0 && constraints > 0) {
+      cout << " and";
     }
-  } catch (z3::exception e) {
-    cerr << e.msg() << endl;
-    return true;
+    if (constraints > 0) {
+      cout << " " << constraints << " constraints";
+    }
+    cout << " at " << steps << " steps";
   }
-  return false;
+  cout << endl;
 }
 
 int main(int argc, char **argv) {
-  const char *filename = "../../testcase/Assays/Testing/Single_2_Input_Mix.txt";
-  if (argc > 1) {
-    filename = argv[1];
+  vector<const char *> files;
+  Synthesizer::Options options;
+  const char *warm_start = nullptr;
+  const char *actuation = nullptr;  // file for the controller, if any
+  bool min_pins = false;
+  const char *profile_file = nullptr;
+  const char *verify_file = nullptr;
+  int repeat = 1;    // rounds of the assays
+  int interval = 0;  // steps between the start of rounds
+  int online = 0;     // steps per block when planning while executing
+  int step_time = 0;  // ms the simulated chip takes per step
+  map<string, Online::Outcome> outcomes;  // of DETECT nodes by label
+  int coarse = 0;  // steps per macro-step when solving coarse first
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--warm-start") == 0 && i + 1 < argc) {
+      warm_start = argv[++i];
+    } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+      options.width = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+      options.height = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      options.timeout = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--explain") == 0 && i + 1 < argc) {
+      options.explain = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profile_file = argv[++i];
+    } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+      options.memory = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      options.workers = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--portfolio") == 0 && i + 1 < argc) {
+      options.portfolio = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--lns") == 0 && i + 1 < argc) {
+      options.lns = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--lns-threads") == 0 && i + 1 < argc) {
+      options.lns_threads = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--no-minimize") == 0) {
+      options.minimize = false;
+    } else if (strcmp(argv[i], "--lazy") == 0) {
+      options.lazy = true;
+    } else if (strcmp(argv[i], "--actuation") == 0 && i + 1 < argc) {
+      actuation = argv[++i];
+    } else if (strcmp(argv[i], "--min-pins") == 0) {
+      min_pins = true;
+    } else if (strcmp(argv[i], "--online") == 0 && i + 1 < argc) {
+      online = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--step-time") == 0 && i + 1 < argc) {
+      step_time = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--outcome") == 0 && i + 1 < argc) {
+      // LABEL=discard or LABEL=repeat
+      string arg = argv[++i];
+      auto pos = arg.find('=');
+      string kind = pos == string::npos ? "" : arg.substr(pos + 1);
+      if (kind != "discard" && kind != "repeat") {
+        cerr << "Unknown outcome " << arg << endl;
+        return 1;
+      }
+      outcomes[arg.substr(0, pos)] =
+          kind == "discard" ? Online::DISCARD : Online::REPEAT;
+    } else if (strcmp(argv[i], "--coarse") == 0 && i + 1 < argc) {
+      coarse = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--no-reduce") == 0) {
+      options.reduce = false;
+    } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+      verify_file = argv[++i];
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+      interval = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      if (!options.device.load(argv[++i])) {
+        cerr << "Failed to load device " << argv[i] << endl;
+        return 1;
+      }
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    files.push_back("../../testcase/Assays/Testing/Single_2_Input_Mix.txt");
+  }
+  // several assays share the chip as one graph of independent parts
+  vector<Graph> assays;
+  for (auto file : files) {
+    assays.emplace_back(file);
+  }
+  Graph input = assays.size() == 1 && repeat == 1
+                    ? assays[0]
+                    : Graph(assays, repeat, interval);
+  int runs = assays.size() * repeat;
+  if (warm_start && !options.warm_start.load(warm_start)) {
+    cerr << "Failed to load schedule " << warm_start << endl;
+    return 1;
+  }
+  if (profile_file) {
+    Profile profile;
+    if (!profile.load(profile_file)) {
+      cerr << "Failed to load profile " << profile_file << endl;
+      return 1;
+    }
+    options.params = profile.get(Profile::classify(files[0]));
+    // a plain solver takes them all
+    auto unsupported = options.minimize
+                           ? Profile::unsupported(options.params)
+                           : Profile::params_type();
+    for (auto &param : unsupported) {
+      cerr << "Ignoring " << param.first << " of profile " << profile_file
+           << ", the optimizer does not take it but --no-minimize would"
+           << endl;
+    }
+  }
+  options.smt2 = "sat.smt2";
+  Synthesizer synthesizer(input, options);
+  // schedules are for the reduced graph, which keeps the node numbers
+  // unless something was removed
+  const Graph &graph = synthesizer.get_graph();
+  if (verify_file) {
+    Schedule schedule;
+    if (!schedule.load(verify_file)) {
+      cerr << "Failed to load schedule " << verify_file << endl;
+      return 1;
+    }
+    Verifier verifier(graph, options.device);
+    if (!verifier.verify(schedule)) {
+      cout << "Schedule violates " << verifier.get_violation() << endl;
+      return 1;
+    }
+    cout << "Schedule is valid in " << schedule.time << " steps" << endl;
+    export_actuation(graph, schedule, actuation, min_pins);
+    return 0;
+  }
+  if (online) {
+    Online::Options online_options;
+    online_options.width = options.width;
+    online_options.height = options.height;
+    online_options.device = options.device;
+    online_options.horizon = online;
+    if (options.timeout) {
+      online_options.timeout = options.timeout;
+    }
+    Online planner(graph, online_options);
+    // a simulated chip, detections pass unless --outcome says otherwise
+    auto execute = [&](const Graph &, const Schedule &schedule, int from,
+                       int to) {
+      cout << "Executing steps " << from << " to " << to << " of "
+           << schedule.time << endl;
+      this_thread::sleep_for(milliseconds(step_time * (to - from + 1)));
+    };
+    auto detect = [&](const Node &node) {
+      auto it = outcomes.find(node.label);
+      auto outcome = it == outcomes.end() ? Online::PASS : it->second;
+      cout << "Detection " << node.label << " "
+           << (outcome == Online::PASS
+                   ? "passed"
+                   : outcome == Online::DISCARD ? "discards" : "repeats")
+           << endl;
+      return outcome;
+    };
+    bool done = planner.run(execute, detect);
+    cout << "First actuation after " << planner.get_first_actuation()
+         << "ms, " << planner.get_replans() << " replans" << endl;
+    if (!done) {
+      cerr << "No schedule completes the assay after step "
+           << planner.get_executed() << endl;
+      return 1;
+    }
+    const Schedule &schedule = planner.get_schedule();
+    cout << "Completed in " << schedule.time << " steps" << endl;
+    cout << "Printing schedule to schedule.txt" << endl;
+    schedule.save("schedule.txt");
+    export_actuation(planner.get_graph(), schedule, actuation, min_pins);
+    return 0;
+  }
+
+  if (coarse) {
+    Coarse planner(graph, options.width, options.height, coarse,
+                   options.device);
+    Schedule schedule;
+    bool found = planner.run(schedule, 100, options.timeout);
+    if (planner.get_unrefined()) {
+      cout << planner.get_unrefined()
+           << " shorter coarse schedules did not refine" << endl;
+    }
+    if (!found) {
+      cerr << "No schedule found" << endl;
+      return 1;
+    }
+    cout << "Refined " << planner.get_macro_steps() << " macro-steps to "
+         << schedule.time << " steps" << endl;
+    cout << "Printing schedule to schedule.txt" << endl;
+    schedule.save("schedule.txt");
+    export_actuation(graph, schedule, actuation, min_pins);
+    return 0;
   }
-  Graph graph(filename);
-  graph.print_to_graphviz("input.dot");
+
+  if (warm_start &&
+      !options.warm_start.fits(graph, options.width, options.height)) {
+    cerr << "Schedule " << warm_start << " is not for this assay on a "
+         << options.width << "x" << options.height << " chip, ignoring it"
+         << endl;
+  }
+  input.print_to_graphviz("input.dot");
   system("dot -Tpng -o input.png input.dot");
-  // try_steps(graph, 6);
-  for (int i = 1; try_steps(graph, 5, 5, i) == false; i++)
-    ;
+
+  int points = 0;  // before local search
+  synthesizer.set_callback([&](const Synthesizer::Progress &progress) {
+    if (progress.phase == Synthesizer::HEURISTIC &&
+        progress.answer != Synthesizer::RUNNING) {
+      bool has_upper = progress.answer == Synthesizer::SAT;
+      if (has_upper) {
+        cout << "Heuristic schedule uses " << progress.step << " steps"
+             << endl;
+      } else {
+        cout << "Heuristic found no schedule" << endl;
+      }
+      if (options.reduce) {
+        print_reduction(input, synthesizer, options,
+                        has_upper ? progress.step : 1);
+      }
+    } else if (progress.phase == Synthesizer::LOCAL_SEARCH) {
+      if (progress.answer == Synthesizer::RUNNING) {
+        points = progress.points;
+      } else {
+        cout << "Local search improved num_points from " << points << " to "
+             << progress.points << " in " << progress.rounds << " rounds"
+             << endl;
+      }
+    } else if (progress.phase == Synthesizer::SEARCH &&
+               progress.answer == Synthesizer::RUNNING) {
+      auto &size = progress.size;
+      cout << "Trying step " << progress.step << endl;
+      cout << "Encoding has " << size.variables << " variables and "
+           << size.constraints << " constraints, about "
+           << (size.bytes >> 20) << "MB" << endl;
+      if (progress.over_budget) {
+        cout << "Exceeds the memory budget of " << options.memory << "MB"
+             << endl;
+      } else if (progress.compact) {
+        cout << "Using the compact fluidic encoding" << endl;
+      }
+    } else if (progress.phase == Synthesizer::SEARCH &&
+               !progress.over_budget) {
+      if (!progress.error.empty()) {
+        cerr << progress.error << endl;
+        return;
+      }
+      if (progress.cubes) {
+        cout << "Solved " << progress.cubes << " cubes on "
+             << options.workers << " workers" << endl;
+      }
+      if (!progress.winner.empty()) {
+        cout << "Answered by " << progress.winner << endl;
+      }
+      cout << "Used " << progress.used << "ms and "
+           << (progress.memory >> 20) << "MB" << endl;
+      if (progress.lazy_groups >= 0) {
+        cout << "Added " << progress.lazy_groups
+             << " groups of fluidic constraints in " << progress.refinements
+             << " refinements" << endl;
+      }
+      if (progress.answer == Synthesizer::UNKNOWN) {
+        cout << "Unknown" << endl;
+      } else if (progress.answer == Synthesizer::UNSAT) {
+        cout << "Unsatisfiable" << endl;
+        if (options.explain) {
+          print_core(progress.core);
+        }
+      } else {
+        cout << "Satisfiable" << endl;
+        cout << "Printing sat constraints to " << options.smt2 << endl;
+      }
+    }
+  });
+  Synthesizer::Result result;
+  try {
+    result = synthesizer.run();
+  } catch (logic_error &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  if (result.status == Synthesizer::FEASIBLE) {
+    cout << "Falling back to the heuristic schedule" << endl;
+  } else if (!result.makespan) {
+    cerr << "No schedule found" << endl;
+    return 1;
+  }
+  cout << "Printing schedule to schedule.txt" << endl;
+  result.schedule.save("schedule.txt");
+  export_actuation(graph, result.schedule, actuation, min_pins);
+  cout << "Printing to model:" << endl;
+  result.schedule.print(graph);
+  if (runs > 1) {
+    cout << "Completes " << runs << " assays in " << result.makespan
+         << " steps" << endl;
+  }
   return 0;
 }
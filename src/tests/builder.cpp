@@ -0,0 +1,88 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+// A graph built in code matches the one read from its file, and the
+// synthesizer schedules it without any file at hand.
+
+#include <iostream>
+#include "Graph.h"
+#include "Synthesizer.h"
+#include "Verifier.h"
+
+using namespace std;
+
+// same_fluid.txt
+static Graph build() {
+  Graph graph;
+  graph.set_name("Same Fluid");
+  Node dispense, output;
+  dispense.type = DISPENSE;
+  dispense.fluid_name = "tris-hcl";
+  dispense.volume = 10;
+  output.type = OUTPUT;
+  output.sink_name = "output";
+  for (int i = 1; i <= 2; i++) {
+    dispense.label = "DIS" + to_string(i);
+    graph.add_node(dispense);
+  }
+  for (int i = 1; i <= 2; i++) {
+    output.label = "OUT" + to_string(i);
+    graph.add_edge(i - 1, graph.add_node(output));
+  }
+  return graph;
+}
+
+static bool same(const Graph &built, const Graph &read) {
+  if (built.get_name() != read.get_name() ||
+      built.get_edges() != read.get_edges() ||
+      built.get_num_output() != read.get_num_output() ||
+      built.get_num_dispenser() != read.get_num_dispenser() ||
+      built.get_nodes().size() != read.get_nodes().size()) {
+    return false;
+  }
+  for (int i = 0; i < read.get_nodes().size(); i++) {
+    auto &a = built.get_nodes()[i], &b = read.get_nodes()[i];
+    if (a.id != b.id || a.type != b.type || a.label != b.label ||
+        a.fluid != b.fluid || a.sink_name != b.sink_name) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " same_fluid.txt" << endl;
+    return 1;
+  }
+  Graph graph = build();
+  if (!same(graph, Graph(argv[1]))) {
+    cerr << "Built graph differs from " << argv[1] << endl;
+    return 1;
+  }
+
+  Synthesizer synthesizer(graph);
+  auto result = synthesizer.run();
+  Verifier verifier(synthesizer.get_graph());
+  if (result.status != Synthesizer::OPTIMAL ||
+      !verifier.verify(result.schedule)) {
+    cerr << "No valid optimal schedule" << endl;
+    return 1;
+  }
+  cout << "Synthesized in " << result.makespan << " steps" << endl;
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Verifier and Solver agree on where dispensed droplets may go: a droplet
+// passing the port of another dispense node of its fluid is valid, one
+// appearing away from any port of its fluid is not.
+
+#include <z3++.h>
+#include <iostream>
+#include "Graph.h"
+#include "Schedule.h"
+#include "Solver.h"
+#include "Verifier.h"
+
+using namespace std;
+
+// droplet 0 from port 0 passes port 2 of droplet 1 on its way to the sink
+// at port 7, then droplet 1 follows. Each OUTPUT node has a sink.
+static Schedule passing() {
+  Schedule schedule(5, 5, 11, 4);
+  Schedule::cell_type first[] = {{0, 0}, {0, 1}, {0, 2}, {0, 3},
+                                 {0, 4}, {1, 4}, {2, 4}};
+  Schedule::cell_type second[] = {{0, 2}, {1, 2}, {2, 2}, {2, 3}, {2, 4}};
+  for (int t = 1; t <= 7; t++) {
+    schedule.droplet[t][0] = first[t - 1];
+  }
+  for (int t = 6; t <= 10; t++) {
+    schedule.droplet[t][1] = second[t - 6];
+  }
+  schedule.dispenser[0] = 0;
+  schedule.dispenser[1] = 2;
+  schedule.sink[7] = true;
+  schedule.sink[8] = true;
+  return schedule;
+}
+
+static bool solvable(const Graph &graph, const Schedule &schedule) {
+  z3::context ctx;
+  Solver solver(ctx, graph, schedule.width, schedule.height, schedule.time);
+  z3::solver plain(ctx);
+  plain.add(solver.get_constraints());
+  for (auto &literal : solver.fix(schedule)) {
+    plain.add(literal);
+  }
+  return plain.check() == z3::sat;
+}
+
+static bool agree(const Graph &graph, const Schedule &schedule,
+                  bool expected, const char *name) {
+  Verifier verifier(graph);
+  bool valid = verifier.verify(schedule);
+  bool sat = solvable(graph, schedule);
+  if (valid != expected || sat != expected) {
+    cerr << name << ": Verifier says " << (valid ? "valid" : "invalid")
+         << ", Solver says " << (sat ? "sat" : "unsat") << ", expected "
+         << (expected ? "valid" : "invalid") << endl;
+    if (!valid) {
+      cerr << "  " << verifier.get_violation() << endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " same_fluid.txt" << endl;
+    return 1;
+  }
+  Graph graph(argv[1]);
+  bool passed = agree(graph, passing(), true, "passing");
+
+  // droplet 1 appears next to no port of its fluid
+  Schedule astray = passing();
+  for (int t = 6; t <= 10; t++) {
+    astray.droplet[t][1].second++;
+  }
+  astray.droplet[10][1] = Schedule::cell_type(-1, -1);
+  passed &= agree(graph, astray, false, "astray");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+// Copyright (C) 2018 Jiajie Chen
+//
+// This file is part of OnePassSynthesisDMFB.
+//
+// OnePassSynthesisDMFB is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OnePassSynthesisDMFB is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OnePassSynthesisDMFB.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Searches solver parameters on a set of training assays and writes the best
+// configuration of each assay class to a profile for OPSDMFB --profile.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string.h>
+#include <z3++.h>
+
+using namespace std::chrono;
+
+#include "Graph.h"
+#include "Profile.h"
+#include "Synthesizer.h"
+
+using namespace z3;
+using namespace std;
+
+struct Dimension {
+  string name;
+  vector<string> values;
+};
+
+// SPACE (name, value1, value2, ...)
+bool load_space(const char *file, vector<Dimension> &space) {
+  ifstream in(file);
+  if (!in) {
+    return false;
+  }
+  while (!in.eof()) {
+    string line;
+    getline(in, line);
+    if (line.find('(') == string::npos)
+      continue;
+
+    string name(line, 0, line.find('('));
+    trim(name);
+
+    auto begin = line.find('(') + 1, next = string::npos;
+    vector<string> params;
+    while ((next = line.find_first_of(",)", begin)) != string::npos) {
+      string param(line, begin, next - begin);
+      trim(param);
+      params.push_back(param);
+      begin = next + 1;
+    }
+
+    if (name == "SPACE" && params.size() >= 2) {
+      space.push_back({params[0], vector<string>(params.begin() + 1,
+                                                 params.end())});
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// milliseconds until the optimal step count is found, or -1 on timeout
+long long solve(const Graph &graph, int size, bool minimize,
+                const Profile::params_type &params, unsigned limit,
+                int &steps) {
+  Synthesizer::Options options;
+  options.width = options.height = size;
+  options.minimize = minimize;
+  options.params = params;
+  Synthesizer synthesizer(graph, options);
+  auto before = steady_clock::now();
+  auto result = synthesizer.run(limit);
+  if (result.status != Synthesizer::OPTIMAL) {
+    return -1;
+  }
+  steps = result.makespan;
+  return duration_cast<milliseconds>(steady_clock::now() - before).count();
+}
+
+int main(int argc, char **argv) {
+  const char *space_file = nullptr;
+  const char *output = "profile.txt";
+  const char *log = "tune.csv";
+  int trials = 0;
+  unsigned seed = 0;
+  unsigned limit = 60000;
+  int size = 5;
+  // tune the optimizer, which takes fewer parameters, or the plain solver
+  bool minimize = false;
+  vector<const char *> files;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--space") == 0 && i + 1 < argc) {
+      space_file = argv[++i];
+    } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      log = argv[++i];
+    } else if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc) {
+      trials = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      limit = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--minimize") == 0) {
+      minimize = true;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    cerr << "Usage: " << argv[0]
+         << " [--space file] [--trials n] [--seed s] [--timeout ms]"
+            " [--size n] [--minimize] [--output profile] [--log csv]"
+            " assay..."
+         << endl;
+    return 1;
+  }
+
+  vector<Dimension> space;
+  if (space_file) {
+    if (!load_space(space_file, space)) {
+      cerr << "Failed to load search space " << space_file << endl;
+      return 1;
+    }
+  } else if (minimize) {
+    space = {{"optsmt_engine", {"basic", "symba"}},
+             {"enable_sat", {"true", "false"}},
+             {"elim_01", {"true", "false"}},
+             {"pb.compile_equality", {"false", "true"}}};
+  } else {
+    space = {{"random_seed", {"0", "1", "2"}},
+             {"phase_selection", {"3", "0", "5"}},
+             {"restart_strategy", {"1", "0"}},
+             {"relevancy", {"2", "0"}},
+             {"arith.solver", {"6", "2"}}};
+  }
+
+  // module parameters would only take effect on optimize as global ones, so
+  // it leaves them out and tuning them would change nothing
+  vector<Dimension> tunable;
+  for (auto &dim : space) {
+    if (!minimize) {
+      tunable.push_back(dim);
+      continue;
+    }
+    Profile::params_type values;
+    for (auto &value : dim.values) {
+      values.emplace_back(dim.name, value);
+    }
+    auto rejected = Profile::unsupported(values);
+    if (rejected.empty()) {
+      tunable.push_back(dim);
+    } else {
+      cerr << "Skipping " << dim.name << ", optimize does not take "
+           << rejected[0].second << endl;
+    }
+  }
+  space = tunable;
+
+  // configuration k picks values by the digits of k in mixed radix,
+  // so configuration 0 takes the first value of every parameter
+  long long total = 1;
+  for (auto &dim : space) {
+    total *= dim.values.size();
+  }
+  vector<long long> configs;
+  if (trials <= 0 || trials >= total) {
+    for (long long k = 0; k < total; k++) {
+      configs.push_back(k);
+    }
+  } else {
+    mt19937_64 rng(seed);
+    uniform_int_distribution<long long> pick(1, total - 1);
+    set<long long> chosen = {0};
+    while (chosen.size() < trials) {
+      chosen.insert(pick(rng));
+    }
+    configs.assign(chosen.begin(), chosen.end());
+  }
+  auto params_of = [&](long long k) {
+    Profile::params_type params;
+    for (auto &dim : space) {
+      params.emplace_back(dim.name, dim.values[k % dim.values.size()]);
+      k /= dim.values.size();
+    }
+    return params;
+  };
+
+  vector<Graph> graphs;
+  vector<string> classes;
+  for (auto file : files) {
+    graphs.emplace_back(file);
+    classes.push_back(Profile::classify(file));
+  }
+
+  // penalized average runtime, a timeout counts as twice the limit
+  map<string, vector<long long>> score;
+  ofstream csv(log);
+  csv << "config,assay,class,steps,ms";
+  for (auto &dim : space) {
+    csv << "," << dim.name;
+  }
+  csv << endl;
+  for (int i = 0; i < configs.size(); i++) {
+    auto params = params_of(configs[i]);
+    cout << "Configuration " << configs[i] << ":";
+    for (auto &param : params) {
+      cout << " " << param.first << "=" << param.second;
+    }
+    cout << endl;
+    for (int j = 0; j < files.size(); j++) {
+      int steps = 0;
+      long long ms = solve(graphs[j], size, minimize, params, limit, steps);
+      if (ms < 0) {
+        cout << "  " << files[j] << ": timeout" << endl;
+      } else {
+        cout << "  " << files[j] << ": " << steps << " steps in " << ms << "ms"
+             << endl;
+      }
+      csv << configs[i] << "," << files[j] << "," << classes[j] << ","
+          << (ms < 0 ? 0 : steps) << "," << ms;
+      for (auto &param : params) {
+        csv << "," << param.second;
+      }
+      csv << endl;
+
+      long long penalty = ms < 0 ? 2ll * limit : ms;
+      for (auto &name : {classes[j], string("default")}) {
+        auto &scores = score[name];
+        scores.resize(configs.size(), 0);
+        scores[i] += penalty;
+      }
+    }
+  }
+
+  Profile profile;
+  for (auto &entry : score) {
+    auto &scores = entry.second;
+    int best = min_element(scores.begin(), scores.end()) - scores.begin();
+    cout << "Best for " << entry.first << ": configuration " << configs[best]
+         << " with score " << scores[best] << endl;
+    profile.set(entry.first, params_of(configs[best]));
+  }
+  cout << "Printing profile to " << output << endl;
+  profile.save(output);
+  return 0;
+}